@@ -0,0 +1,679 @@
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <cstring>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "antlr4-runtime.h"
+#include "ELLexer.h"
+#include "ELParser.h"
+#include "ELBaseListener.h"
+
+#include "Bytecodes.hpp"
+
+#include "BytecodeCompiler.hpp"
+#include "ELStreamParser.hpp"
+#include "ELOptimizer.hpp"
+#include "ELCompiler.hpp"
+
+using namespace std;
+using namespace antlr4;
+
+#if defined(EL_IS_BIG_ENDIAN)
+#define convertToBigEndian(x)
+#else
+#if defined(__linux__)
+#include <byteswap.h>
+#define convertToBigEndian(x) x = bswap_64(x)
+#elif defined(__APPLE__)
+#include <libkern/OSByteOrder.h>
+#define convertToBigEndian(x) x = OSSwapInt64(x)
+#elif defined(_MSC_VER)
+#include <stdlib.h>
+#define convertToBigEndian(x) x = _byteswap_uint64(x)
+#else
+#error Platform does not provide convertToBigEndian functionality
+#endif
+#endif
+
+// Instruction
+int64_t Instruction::encodingLength() {
+    return SIZEOF_BYTE + instructionDataLength();
+}
+string Instruction::getName() {
+    return _name;
+}
+string Instruction::getDisplayString() {
+    return getName();
+}
+void Instruction::encode(class MyListener *listener, class Function *function, ostream *stream) {
+    stream->write((char *)&_bytecode, 1);
+    encodeData(listener, function, stream);
+}
+void Instruction::encodeCompact(class MyListener *listener, class Function *function, int64_t offset, ostream *stream) {
+    stream->write((char *)&_bytecode, 1);
+    encodeCompactData(listener, function, offset, stream);
+}
+int64_t Instruction::instructionDataLength() {
+    return 0;
+}
+bool Instruction::isLabel() {
+    return false;
+}
+void Instruction::write(ostream *stream, int64_t value) {
+    convertToBigEndian(value);
+    stream->write((char *)&value, sizeof(int64_t));
+}
+void Instruction::write(ostream *stream, string value) {
+    stream->write(value.data(), value.length());
+}
+void Instruction::writeImmediate(MyListener *listener, ostream *stream, int64_t value) {
+    if (listener->isNativeLayout()) {
+        stream->write((char *)&value, sizeof(int64_t));
+    } else {
+        write(stream, value);
+    }
+}
+void Instruction::writeVarint(ostream *stream, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (0 != value) {
+            byte |= 0x80;
+        }
+        stream->write((char *)&byte, 1);
+    } while (0 != value);
+}
+void Instruction::writeSignedVarint(ostream *stream, int64_t value) {
+    writeVarint(stream, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+// OneArgInstruction
+string OneArgInstruction::getDisplayString() {
+    return getName() + " " + to_string(_arg);
+}
+int64_t OneArgInstruction::instructionDataLength() {
+    return SIZEOF_LONG;
+}
+void OneArgInstruction::encodeData(class MyListener *listener, class Function *function, ostream *stream) {
+    writeImmediate(listener, stream, _arg);
+}
+void OneArgInstruction::encodeCompactData(class MyListener *listener, class Function *function, int64_t offset, ostream *stream) {
+    if (Bytecodes::PUSH_CONSTANT == getBytecode()) {
+        writeSignedVarint(stream, _arg);
+    } else {
+        writeVarint(stream, _arg);
+    }
+}
+
+// CallInstruction
+string CallInstruction::getDisplayString() {
+    return getName() + " " + _functionName + " " + to_string(_argCount);
+}
+int64_t CallInstruction::instructionDataLength() {
+    return SIZEOF_LONG + SIZEOF_LONG;
+}
+void CallInstruction::encodeData(MyListener *listener, Function *function, ostream *stream) {
+    int64_t functionID = listener->getFunction(_functionName)->getFunctionID();
+    writeImmediate(listener, stream, functionID);
+    writeImmediate(listener, stream, _argCount);
+}
+void CallInstruction::encodeCompactData(MyListener *listener, Function *function, int64_t offset, ostream *stream) {
+    writeVarint(stream, listener->getFunction(_functionName)->getFunctionID());
+    writeVarint(stream, _argCount);
+}
+
+// JumpInstruction
+int64_t JumpInstruction::instructionDataLength() {
+    return SIZEOF_LONG;
+}
+string JumpInstruction::getDisplayString() {
+    return getName() + " " + _labelName;
+}
+void JumpInstruction::encodeData(class MyListener *listener, class Function *function, ostream *stream) {
+    writeImmediate(listener, stream, _target);
+}
+void JumpInstruction::encodeCompactData(class MyListener *listener, class Function *function, int64_t offset, ostream *stream) {
+    writeSignedVarint(stream, _target - offset);
+}
+
+// PrintStringInstruction
+int64_t PrintStringInstruction::instructionDataLength() {
+    return SIZEOF_LONG;
+}
+string PrintStringInstruction::getDisplayString() {
+    return getName() + " " + _text;
+}
+void PrintStringInstruction::encodeData(MyListener *listener, Function *function, ostream *stream) {
+    int64_t stringID = listener->getStringID(_encodedText);
+    writeImmediate(listener, stream, stringID);
+}
+void PrintStringInstruction::encodeCompactData(MyListener *listener, Function *function, int64_t offset, ostream *stream) {
+    writeVarint(stream, listener->getStringID(_encodedText));
+}
+
+// Function
+int64_t Function::getFunctionID() {
+    return _functionID;
+}
+void Function::addInstruction(Instruction *ins) {
+    _functionSize += ins->encodingLength();
+    _instructions.push_back(ins);
+}
+void Function::addLabel(const string &labelName) {
+    _labels.insert(pair<string,int64_t>(labelName,_functionSize));
+}
+/* Labels can be used before they are defined, so jumps get their offsets once the whole body is known */
+void Function::resolveLabels() {
+    for(vector<Instruction *>::iterator it = _instructions.begin(); it != _instructions.end(); ++it) {
+        Instruction *instruction = *it;
+        switch (instruction->getBytecode()) {
+        case Bytecodes::JMP:
+        case Bytecodes::JMPE:
+        case Bytecodes::JMPL:
+        case Bytecodes::JMPG:
+        {
+            JumpInstruction *jump = (JumpInstruction *)instruction;
+            jump->setTarget(getLabelAddress(jump->getLabelName()));
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+int64_t Function::getFunctionSize() {
+    return _functionSize;
+}
+const vector<Instruction *> &Function::getInstructions() {
+    return _instructions;
+}
+/* jumps in the new list must already have their targets set */
+void Function::replaceInstructions(const vector<Instruction *> &instructions, const map<string, int64_t> &labels) {
+    _instructions = instructions;
+    _labels = labels;
+    _functionSize = 0;
+    for(vector<Instruction *>::iterator it = _instructions.begin(); it != _instructions.end(); ++it) {
+        _functionSize += (*it)->encodingLength();
+    }
+}
+
+int64_t Function::getLabelAddress(const string &label) {
+    map<string,int64_t>::iterator it;
+    it = _labels.find(label);
+    if (it == _labels.end()) {
+        cerr << "Error: function " << _functionName << " jumps to undefined label " << label << endl;
+        exit(-11);
+    }
+    return it->second;
+}
+/* Same walk the runtime loader does, so a function directory can carry the
+ * results and the loader only has to confirm them.
+ */
+void Function::computeStackMetadata(int64_t *maxStackDepth, int64_t *localCount) {
+    map<int64_t, int64_t> destinationStackSizes;
+    int64_t currentStackDepth = 0;
+    int64_t maxDepth = 0;
+    int64_t maxLocalID = -1;
+    int64_t offset = 0;
+    for(vector<Instruction *>::iterator it = _instructions.begin(); it != _instructions.end(); ++it) {
+        Instruction *instruction = *it;
+        map<int64_t, int64_t>::iterator destination = destinationStackSizes.find(offset);
+        if (destination != destinationStackSizes.end()) {
+            currentStackDepth = destination->second;
+        } else {
+            destinationStackSizes.insert(make_pair(offset, currentStackDepth));
+        }
+
+        switch (instruction->getBytecode()) {
+        case Bytecodes::PUSH_CONSTANT:
+        case Bytecodes::PUSH_ARG:
+        case Bytecodes::DUP:
+        case Bytecodes::CURRENT_TIME:
+            currentStackDepth += 1;
+            break;
+        case Bytecodes::PUSH_LOCAL:
+            maxLocalID = max(maxLocalID, ((OneArgInstruction *)instruction)->getArg());
+            currentStackDepth += 1;
+            break;
+        case Bytecodes::POP_LOCAL:
+            maxLocalID = max(maxLocalID, ((OneArgInstruction *)instruction)->getArg());
+            currentStackDepth -= 1;
+            break;
+        case Bytecodes::POP:
+        case Bytecodes::ADD:
+        case Bytecodes::SUB:
+        case Bytecodes::MUL:
+        case Bytecodes::DIV:
+        case Bytecodes::MOD:
+        case Bytecodes::PRINT_INT64:
+            currentStackDepth -= 1;
+            break;
+        case Bytecodes::JMP:
+            destinationStackSizes.insert(make_pair(((JumpInstruction *)instruction)->getTarget(), currentStackDepth));
+            currentStackDepth = -1;
+            break;
+        case Bytecodes::JMPE:
+        case Bytecodes::JMPL:
+        case Bytecodes::JMPG:
+            currentStackDepth -= 2;
+            destinationStackSizes.insert(make_pair(((JumpInstruction *)instruction)->getTarget(), currentStackDepth));
+            break;
+        case Bytecodes::CALL:
+            currentStackDepth -= ((CallInstruction *)instruction)->getArgCount() - 1;
+            break;
+        case Bytecodes::RET:
+        case Bytecodes::HALT:
+            currentStackDepth = -1;
+            break;
+        default:
+            break;
+        }
+        maxDepth = max(maxDepth, currentStackDepth);
+        offset += instruction->encodingLength();
+    }
+    *maxStackDepth = maxDepth;
+    *localCount = maxLocalID + 1;
+}
+
+// InstructionArena
+InstructionArena::~InstructionArena() {
+    for(vector<Instruction *>::iterator it = _instructions.begin(); it != _instructions.end(); ++it) {
+        (*it)->~Instruction();
+    }
+    for(vector<char *>::iterator it = _chunks.begin(); it != _chunks.end(); ++it) {
+        free(*it);
+    }
+}
+void *InstructionArena::allocate(size_t size) {
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    if (_used + size > CHUNK_SIZE) {
+        char *chunk = (char *)malloc(CHUNK_SIZE);
+        if (nullptr == chunk) {
+            cerr << "Error: could not allocate Instruction\n";
+            exit(-10);
+        }
+        _chunks.push_back(chunk);
+        _used = 0;
+    }
+    void *memory = _chunks.back() + _used;
+    _used += size;
+    return memory;
+}
+
+// MyListener
+void MyListener::enterProgram(elgrammar::ELParser::ProgramContext *ctx) {
+   _programName = ctx->programName()->NAME()->getText();
+}
+
+Function *MyListener::addFunction(const string &functionName, int64_t argCount) {
+    map<string,Function>::iterator it;
+    it = _functions.find(functionName);
+    if (it != _functions.end()) {
+        cerr << "Error: duplicate function named " << functionName << endl;
+        exit(-9);
+    }
+
+    int64_t functionID = _functionCount++;
+    return &_functions.insert(pair<string, Function>(functionName, Function(functionName, functionID, argCount))).first->second;
+}
+
+void MyListener::enterFunctionDeclaration(elgrammar::ELParser::FunctionDeclarationContext *ctx) {
+    string functionName = ctx->functionName()->getText();
+    int64_t argCount = (int64_t)atol(ctx->functionArgCount()->integer()->getText().c_str());
+    Function &func = *addFunction(functionName, argCount);
+    elgrammar::ELParser::FunctionBodyContext *body = ctx->functionBody();
+    vector<elgrammar::ELParser::InstructionContext *> instructions = body->instruction();
+    for (vector<elgrammar::ELParser::InstructionContext *>::iterator it = instructions.begin(); it != instructions.end(); ++it) {
+        elgrammar::ELParser::InstructionContext *insCtx = *it;
+        Instruction *ins = nullptr;
+
+        elgrammar::ELParser::NoArgInstructionContext *noArg = insCtx->noArgInstruction();
+        elgrammar::ELParser::OneArgInstructionContext *oneArg = insCtx->oneArgInstruction();
+        elgrammar::ELParser::CallInstructionContext *call = insCtx->callInstruction();
+        elgrammar::ELParser::JumpInstructionContext *jump = insCtx->jumpInstruction();
+        elgrammar::ELParser::PrintStringInstructionContext *printString = insCtx->printStringInstruction();
+        elgrammar::ELParser::LabelContext *label = insCtx->label();
+
+        if (noArg != nullptr) {
+            ins = createInstruction<Instruction>(Bytecode::getBytecode(noArg->instructionName()->getText()));
+        } else if (oneArg != nullptr) {
+            ins = createInstruction<OneArgInstruction>(Bytecode::getBytecode(oneArg->instructionName()->getText()), (int64_t)atol(oneArg->integer()->getText().c_str()));
+        } else if (call != nullptr) {
+            string functionName = call->functionName()->getText();
+            string argCount = call->integer()->getText();
+            ins = createInstruction<CallInstruction>(Bytecode::getBytecode(call->instructionName()->getText()), functionName, (int64_t)atol(argCount.c_str()));
+        } else if (jump != nullptr) {
+            ins = createInstruction<JumpInstruction>(Bytecode::getBytecode(jump->instructionName()->getText()), jump->labelName()->getText());
+        } else if (label != nullptr) {
+            func.addLabel(label->labelName()->getText());
+            continue;
+        } else if (printString != nullptr) {
+            ins = createInstruction<PrintStringInstruction>(Bytecode::getBytecode(printString->instructionName()->getText()), printString->string()->getText());
+        } else {
+            fprintf(stderr, "Unexpected instruction parsed\n");
+            exit(-9);
+        }
+        func.addInstruction(ins);
+    }
+    func.resolveLabels();
+}
+
+const char *MyListener::getProgramName() {
+    return _programName.c_str();
+}
+
+Function *MyListener::getFunction(const string &functionName) {
+    map<string,Function>::iterator it;
+    it = _functions.find(functionName);
+    if (it == _functions.end()) {
+        cerr << "Error: call to undefined function " << functionName << endl;
+        exit(-11);
+    }
+    return &it->second;
+}
+
+int64_t MyListener::getStringID(const string &str) {
+    map<string,int64_t>::iterator it;
+    it = _strings.find(str);
+    if (it == _strings.end()) {
+        int64_t stringID = _stringCount;
+        _strings.insert(pair<string,int64_t>(str,_stringCount++));
+        return stringID;
+    } else {
+        return it->second;
+    }
+}
+
+#define EYECATCHER "ELLE"
+
+static string encodeFunctionBody(MyListener *listener, Function *function, int64_t formatVersion) {
+    ostringstream body;
+    const vector<Instruction *> &instructions = function->getInstructions();
+    int64_t offset = 0;
+    for(vector<Instruction *>::const_iterator it = instructions.begin(); it != instructions.end(); ++it) {
+        Instruction *instruction = *it;
+        if ((formatVersion >= FORMAT_VERSION_COMPACT) && !listener->isNativeLayout()) {
+            instruction->encodeCompact(listener, function, offset, &body);
+        } else {
+            instruction->encode(listener, function, &body);
+        }
+        offset += instruction->encodingLength();
+    }
+    return body.str();
+}
+
+/* name lengths and the function count were a single signed byte before FORMAT_VERSION_VARINT_COUNTS */
+static bool writeCount(ostream *stream, int64_t value, int64_t formatVersion) {
+    if (formatVersion >= FORMAT_VERSION_VARINT_COUNTS) {
+        Instruction::writeVarint(stream, value);
+        return true;
+    }
+    if (value > 127) {
+        return false;
+    }
+    int8_t byte = (int8_t)value;
+    stream->write((char *)&byte, 1);
+    return true;
+}
+
+static void writeInt64At(ostream &file, streampos position, int64_t value) {
+    convertToBigEndian(value);
+    file.seekp(position);
+    file.write((char *)&value, sizeof(int64_t));
+}
+
+static void parseWithAntlr(istream &stream, MyListener *listener) {
+    ANTLRInputStream input(stream);
+    elgrammar::ELLexer lexer(&input);
+    CommonTokenStream tokens(&lexer);
+    elgrammar::ELParser parser(&tokens);
+
+    elgrammar::ELParser::ProgramContext* tree = parser.program();
+    tree::ParseTreeWalker::DEFAULT.walk(listener, tree);
+}
+
+static bool parseWithStreamParser(istream &stream, MyListener *listener) {
+    ELStreamParser parser(&stream, listener);
+    return parser.parseProgram();
+}
+
+/* Both front ends have to produce exactly the same functions and instructions */
+static bool sameProgram(MyListener *expected, MyListener *actual) {
+    if (0 != strcmp(expected->getProgramName(), actual->getProgramName())) {
+        cerr << "Program name " << actual->getProgramName() << " != " << expected->getProgramName() << endl;
+        return false;
+    }
+    map<string, Function> &expectedFunctions = expected->getFunctions();
+    map<string, Function> &actualFunctions = actual->getFunctions();
+    if (expectedFunctions.size() != actualFunctions.size()) {
+        cerr << "Function count " << actualFunctions.size() << " != " << expectedFunctions.size() << endl;
+        return false;
+    }
+    map<string,Function>::iterator e = expectedFunctions.begin();
+    map<string,Function>::iterator a = actualFunctions.begin();
+    for (; e != expectedFunctions.end(); ++e, ++a) {
+        Function *expectedFunction = &e->second;
+        Function *actualFunction = &a->second;
+        if ((e->first != a->first)
+            || (expectedFunction->getFunctionID() != actualFunction->getFunctionID())
+            || (expectedFunction->getArgCount() != actualFunction->getArgCount())
+            || (expectedFunction->getFunctionSize() != actualFunction->getFunctionSize())
+            || (expectedFunction->getInstructions().size() != actualFunction->getInstructions().size())) {
+            cerr << "Function " << a->first << " does not match " << e->first << endl;
+            return false;
+        }
+        const vector<Instruction *> &expectedInstructions = expectedFunction->getInstructions();
+        const vector<Instruction *> &actualInstructions = actualFunction->getInstructions();
+        for (size_t i = 0; i < expectedInstructions.size(); i++) {
+            Instruction *expectedInstruction = expectedInstructions[i];
+            Instruction *actualInstruction = actualInstructions[i];
+            bool same = (expectedInstruction->getBytecode() == actualInstruction->getBytecode())
+                && (expectedInstruction->getDisplayString() == actualInstruction->getDisplayString());
+            JumpInstruction *expectedJump = dynamic_cast<JumpInstruction *>(expectedInstruction);
+            JumpInstruction *actualJump = dynamic_cast<JumpInstruction *>(actualInstruction);
+            if (same && (nullptr != expectedJump)) {
+                same = (nullptr != actualJump) && (expectedJump->getTarget() == actualJump->getTarget());
+            }
+            if (!same) {
+                cerr << "Function " << e->first << " instruction " << i << ": " << actualInstruction->getDisplayString()
+                     << " != " << expectedInstruction->getDisplayString() << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void setDefaultCompilerOptions(CompilerOptions *options) {
+    options->formatVersion = FORMAT_VERSION_CURRENT;
+    options->nativeLayout = false;
+    options->functionDirectory = false;
+    options->useStreamParser = false;
+    options->checkFrontEnd = false;
+    options->optimizationLevel = 0;
+}
+
+int compileProgram(istream &source, const char *sourceName, CompilerOptions *options, ostream *output) {
+    int64_t formatVersion = options->formatVersion;
+    bool nativeLayout = options->nativeLayout;
+    bool functionDirectory = options->functionDirectory;
+    ostream &compiledFile = *output;
+
+    MyListener listener;
+    listener.setNativeLayout(nativeLayout);
+    if (options->useStreamParser) {
+        if (!parseWithStreamParser(source, &listener)) {
+            return -8;
+        }
+    } else {
+        parseWithAntlr(source, &listener);
+    }
+
+    if (options->checkFrontEnd) {
+        /* parse again with the other front end and make sure nothing differs */
+        source.clear();
+        source.seekg(0);
+        MyListener checkListener;
+        bool parsed = true;
+        if (options->useStreamParser) {
+            parseWithAntlr(source, &checkListener);
+        } else {
+            parsed = parseWithStreamParser(source, &checkListener);
+        }
+        if (!parsed || !sameProgram(&checkListener, &listener)) {
+            cerr << "Error: the ANTLR and stream front ends disagree on " << sourceName << endl;
+            return -8;
+        }
+    }
+
+    if (options->optimizationLevel > 0) {
+        ELOptimizer optimizer(&listener, options->optimizationLevel);
+        map<string, Function> &functions = listener.getFunctions();
+        for (map<string, Function>::iterator it = functions.begin(); it != functions.end(); ++it) {
+            optimizer.optimize(&it->second);
+        }
+    }
+
+    compiledFile.write(EYECATCHER, strlen(EYECATCHER));
+
+    if (formatVersion > FORMAT_VERSION_0) {
+        int8_t formatFlags = 0;
+        if (nativeLayout) {
+            formatFlags |= FORMAT_FLAG_NATIVE;
+#if defined(EL_IS_BIG_ENDIAN)
+            formatFlags |= FORMAT_FLAG_BIG_ENDIAN;
+#endif
+        }
+        if (functionDirectory) {
+            formatFlags |= FORMAT_FLAG_FUNCTION_DIRECTORY;
+        }
+        int8_t versionHeader[2] = { (int8_t)(FORMAT_VERSION_MARKER | formatVersion), formatFlags };
+        compiledFile.write((char *)versionHeader, sizeof(versionHeader));
+    }
+
+    const char *programName = listener.getProgramName();
+    size_t programNameLength = strlen(programName);
+    if (!writeCount(&compiledFile, programNameLength, formatVersion)) {
+        cerr << "Error program name is limited to 127 characters before format version " << FORMAT_VERSION_VARINT_COUNTS << endl;
+        return -5;
+    }
+    compiledFile.write(programName, programNameLength);
+    if (nativeLayout) {
+        compiledFile.put('\0');
+    }
+
+    int64_t functionCount = listener.getFunctionCount();
+    if (!writeCount(&compiledFile, functionCount, formatVersion)) {
+        cerr << "Error number of functions is limited to 127 before format version " << FORMAT_VERSION_VARINT_COUNTS << endl;
+        return -6;
+    }
+
+    map<string, Function> &functions = listener.getFunctions();
+    map<string,Function>::iterator it;
+    vector<string> bodies;
+    vector<streampos> bodyOffsetPositions;
+    for (it = functions.begin(); it != functions.end(); ++it) {
+        Function *func = &it->second;
+        const char *functionName = it->first.c_str();
+        size_t functionNameLength = strlen(functionName);
+        if (!writeCount(&compiledFile, functionNameLength, formatVersion)) {
+             cerr << "Error function name is limited to 127 characters before format version " << FORMAT_VERSION_VARINT_COUNTS << endl;
+             return -7;
+         }
+        compiledFile.write(functionName, functionNameLength);
+        if (nativeLayout) {
+            compiledFile.put('\0');
+        }
+
+        int64_t functionID = it->second.getFunctionID();
+        convertToBigEndian(functionID);
+        compiledFile.write((char *)&functionID, sizeof(int64_t));
+
+        int64_t argCount = it->second.getArgCount();
+        convertToBigEndian(argCount);
+        compiledFile.write((char *)&argCount, sizeof(int64_t));
+
+        int64_t functionSize = it->second.getFunctionSize();
+        convertToBigEndian(functionSize);
+        compiledFile.write((char *)&functionSize, sizeof(int64_t));
+
+        string body = encodeFunctionBody(&listener, func, formatVersion);
+        if (formatVersion >= FORMAT_VERSION_COMPACT) {
+            int64_t encodedSize = body.length();
+            convertToBigEndian(encodedSize);
+            compiledFile.write((char *)&encodedSize, sizeof(int64_t));
+        }
+
+        if (functionDirectory) {
+            int64_t maxStackDepth = 0;
+            int64_t localCount = 0;
+            func->computeStackMetadata(&maxStackDepth, &localCount);
+            convertToBigEndian(maxStackDepth);
+            compiledFile.write((char *)&maxStackDepth, sizeof(int64_t));
+            convertToBigEndian(localCount);
+            compiledFile.write((char *)&localCount, sizeof(int64_t));
+            /* patched once the body has been placed */
+            int64_t bodyOffset = 0;
+            bodyOffsetPositions.push_back(compiledFile.tellp());
+            compiledFile.write((char *)&bodyOffset, sizeof(int64_t));
+            bodies.push_back(body);
+            continue;
+        }
+
+        if (nativeLayout) {
+            while (0 != (compiledFile.tellp() % FORMAT_NATIVE_BODY_ALIGNMENT)) {
+                compiledFile.put('\0');
+            }
+        }
+        compiledFile.write(body.data(), body.length());
+    }
+
+    streampos stringTableOffsetPosition = 0;
+    vector<int64_t> bodyOffsets;
+    if (functionDirectory) {
+        int64_t stringTableOffset = 0;
+        stringTableOffsetPosition = compiledFile.tellp();
+        compiledFile.write((char *)&stringTableOffset, sizeof(int64_t));
+        for (size_t i = 0; i < bodies.size(); i++) {
+            if (nativeLayout) {
+                while (0 != (compiledFile.tellp() % FORMAT_NATIVE_BODY_ALIGNMENT)) {
+                    compiledFile.put('\0');
+                }
+            }
+            bodyOffsets.push_back(compiledFile.tellp());
+            compiledFile.write(bodies[i].data(), bodies[i].length());
+        }
+    }
+    int64_t stringTableOffset = compiledFile.tellp();
+
+    //Write strings out
+    int64_t stringCount = listener.getStringCount();
+    convertToBigEndian(stringCount);
+    compiledFile.write((char *)&stringCount, sizeof(int64_t));
+
+    const map<string, int64_t> &strings = listener.getStrings();
+    map<string,int64_t>::const_iterator iter;
+    for (iter = strings.begin(); iter != strings.end(); ++iter) {
+        int64_t stringID = iter->second;
+        convertToBigEndian(stringID);
+        compiledFile.write((char *)&stringID, sizeof(int64_t));
+        int64_t stringLength = iter->first.length();
+        convertToBigEndian(stringLength);
+        compiledFile.write((char *)&stringLength, sizeof(int64_t));
+        compiledFile.write(iter->first.data(), iter->first.length());
+    }
+
+    //Write out the eyecatcher again
+    compiledFile.write(EYECATCHER, strlen("ELLE"));
+
+    if (functionDirectory) {
+        for (size_t i = 0; i < bodyOffsetPositions.size(); i++) {
+            writeInt64At(compiledFile, bodyOffsetPositions[i], bodyOffsets[i]);
+        }
+        writeInt64At(compiledFile, stringTableOffsetPosition, stringTableOffset);
+    }
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <utility>
+#include <new>
 
 using namespace std;
 using namespace antlr4;
@@ -12,20 +14,25 @@ public:
         _name(Bytecode::getBytecodeName(bytecode))
     {}
     virtual ~Instruction() {};
+    Bytecodes getBytecode() { return _bytecode; }
+    static void writeVarint(ostream *stream, uint64_t value);
     int64_t encodingLength();
     string getName();
     virtual string getDisplayString();
-    void encode(class MyListener *listener, class Function *function, ofstream *stream);
+    void encode(class MyListener *listener, class Function *function, ostream *stream);
+    void encodeCompact(class MyListener *listener, class Function *function, int64_t offset, ostream *stream);
 protected:
     static const int SIZEOF_BYTE = 1;
     static const int SIZEOF_LONG = 8;
 
-    Bytecodes getBytecode() { return _bytecode; }
     virtual int64_t instructionDataLength();
     virtual bool isLabel();
-    virtual void encodeData(class MyListener *listener, class Function *function, ofstream *stream){}
-    void write(ofstream *stream, int64_t value);
-    void write(ofstream *stream, string value);
+    virtual void encodeData(class MyListener *listener, class Function *function, ostream *stream){}
+    virtual void encodeCompactData(class MyListener *listener, class Function *function, int64_t offset, ostream *stream){}
+    void write(ostream *stream, int64_t value);
+    void write(ostream *stream, string value);
+    void writeImmediate(class MyListener *listener, ostream *stream, int64_t value);
+    void writeSignedVarint(ostream *stream, int64_t value);
 private:
     Bytecodes _bytecode;
     string _name;
@@ -38,9 +45,11 @@ public:
         _arg(arg)
     {}
     virtual string getDisplayString();
+    int64_t getArg() { return _arg; }
 protected:
     virtual int64_t instructionDataLength();
-    virtual void encodeData(class MyListener *listener, class Function *function, ofstream *stream);
+    virtual void encodeData(class MyListener *listener, class Function *function, ostream *stream);
+    virtual void encodeCompactData(class MyListener *listener, class Function *function, int64_t offset, ostream *stream);
 private:
     int64_t _arg;
 };
@@ -53,9 +62,11 @@ public:
         _argCount(argCount)
     {}
     virtual string getDisplayString();
+    int64_t getArgCount() { return _argCount; }
 protected:
     virtual int64_t instructionDataLength();
-    virtual void encodeData(class MyListener *listener, class Function *function, ofstream *stream);
+    virtual void encodeData(class MyListener *listener, class Function *function, ostream *stream);
+    virtual void encodeCompactData(class MyListener *listener, class Function *function, int64_t offset, ostream *stream);
 private:
     string _functionName;
     int64_t _argCount;
@@ -65,15 +76,20 @@ class JumpInstruction : public Instruction {
 public:
     JumpInstruction(Bytecodes bytecode, string labelName) :
         Instruction(bytecode),
-        _labelName(labelName)
+        _labelName(labelName),
+        _target(-1)
     {}
     virtual int64_t instructionDataLength();
     virtual string getDisplayString();
-    string getLabelName();
+    const string &getLabelName() { return _labelName; }
+    int64_t getTarget() { return _target; }
+    void setTarget(int64_t target) { _target = target; }
 protected:
-    virtual void encodeData(class MyListener *listener, class Function *function, ofstream *stream);
+    virtual void encodeData(class MyListener *listener, class Function *function, ostream *stream);
+    virtual void encodeCompactData(class MyListener *listener, class Function *function, int64_t offset, ostream *stream);
 private:
     string _labelName;
+    int64_t _target; /* canonical offset of the label, filled in by Function::resolveLabels */
 };
 
 class PrintStringInstruction : public Instruction {
@@ -94,7 +110,8 @@ public:
     virtual string getDisplayString();
     string getEncodedText() { return _encodedText; }
 protected:
-    void encodeData(MyListener *listener, Function *function, ofstream *stream);
+    void encodeData(MyListener *listener, Function *function, ostream *stream);
+    void encodeCompactData(MyListener *listener, Function *function, int64_t offset, ostream *stream);
 private:
     string _text;
     string _encodedText;
@@ -111,12 +128,17 @@ public:
         _labels()
     {};
     void addInstruction(Instruction *ins);
-    void addLabel(string labelName);
+    void addLabel(const string &labelName);
+    void resolveLabels();
     int64_t getFunctionID();
+    const string &getFunctionName() { return _functionName; }
     int64_t getArgCount() { return _argCount; }
     int64_t getFunctionSize();
-    vector<Instruction *> getInstructions();
-    int64_t getLabelAddress(string label);
+    const vector<Instruction *> &getInstructions();
+    const map<string, int64_t> &getLabels() { return _labels; }
+    void replaceInstructions(const vector<Instruction *> &instructions, const map<string, int64_t> &labels);
+    int64_t getLabelAddress(const string &label);
+    void computeStackMetadata(int64_t *maxStackDepth, int64_t *localCount);
 
 private:
     string _functionName;
@@ -127,28 +149,71 @@ private:
     map<string, int64_t> _labels;
 };
 
-class MyListener : public ELBaseListener {
+/* Owns every Instruction of a compilation. Instructions are carved out of
+ * large chunks instead of being allocated one at a time and all go away
+ * together with the arena.
+ */
+class InstructionArena {
+public:
+    InstructionArena() :
+        _chunks(),
+        _used(CHUNK_SIZE),
+        _instructions()
+    {}
+    InstructionArena(const InstructionArena &) = delete;
+    ~InstructionArena();
+
+    template<typename T, typename... Args>
+    T *create(Args&&... args) {
+        void *memory = allocate(sizeof(T));
+        T *instruction = new (memory) T(std::forward<Args>(args)...);
+        _instructions.push_back(instruction);
+        return instruction;
+    }
+
+private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    void *allocate(size_t size);
+
+    vector<char *> _chunks;
+    size_t _used;
+    vector<Instruction *> _instructions;
+};
+
+class MyListener : public elgrammar::ELBaseListener {
 public:
     MyListener() :
         _programName(),
         _functionCount(0),
         _stringCount(0),
+        _nativeLayout(false),
         _functions(),
-        _strings()
+        _strings(),
+        _arena()
     {}
-    void enterProgram(ELParser::ProgramContext *ctx) override;
-    void enterFunctionDeclaration(ELParser::FunctionDeclarationContext *ctx) override;
+    void enterProgram(elgrammar::ELParser::ProgramContext *ctx) override;
+    void enterFunctionDeclaration(elgrammar::ELParser::FunctionDeclarationContext *ctx) override;
     const char *getProgramName();
-    map<string, Function> getFunctions();
+    void setProgramName(const string &programName) { _programName = programName; }
+    Function *addFunction(const string &functionName, int64_t argCount);
+    template<typename T, typename... Args>
+    T *createInstruction(Args&&... args) { return _arena.create<T>(std::forward<Args>(args)...); }
+    map<string, Function> &getFunctions() { return _functions; }
+    Function *getFunction(const string &functionName);
     int64_t getFunctionCount() { return _functionCount; }
-    int64_t getStringID(string str);
+    int64_t getStringID(const string &str);
     int64_t getStringCount() { return _stringCount; }
-    map<string,int64_t> getStrings() { return _strings; }
+    const map<string,int64_t> &getStrings() { return _strings; }
+    bool isNativeLayout() { return _nativeLayout; }
+    void setNativeLayout(bool nativeLayout) { _nativeLayout = nativeLayout; }
 
 private:
     string _programName;
     int64_t _functionCount;
     int64_t _stringCount;
+    bool _nativeLayout;
     map<string, Function> _functions;
     map<string, int64_t> _strings;
+    InstructionArena _arena;
 };
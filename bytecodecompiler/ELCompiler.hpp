@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include <iostream>
+
+#ifndef ELCOMPILER_INCL
+#define ELCOMPILER_INCL
+
+typedef struct CompilerOptions {
+    int64_t formatVersion;
+    bool nativeLayout;
+    bool functionDirectory;
+    bool useStreamParser;
+    bool checkFrontEnd;
+    int64_t optimizationLevel; /* 0 emits exactly what the source says, up to 2 */
+} CompilerOptions;
+
+void setDefaultCompilerOptions(CompilerOptions *options);
+
+/* Compiles EL source into a .le image written to output. Returns 0, or the
+ * elc exit code for the first error found. output has to be seekable when
+ * options->functionDirectory is set.
+ */
+int compileProgram(std::istream &source, const char *sourceName, CompilerOptions *options, std::ostream *output);
+
+#endif /* ELCOMPILER_INCL */
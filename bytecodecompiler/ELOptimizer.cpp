@@ -0,0 +1,544 @@
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include "antlr4-runtime.h"
+#include "ELParser.h"
+#include "ELBaseListener.h"
+#include "Bytecodes.hpp"
+#include "BytecodeCompiler.hpp"
+#include "ELOptimizer.hpp"
+
+bool ELOptimizer::isJump(Bytecodes bytecode) {
+    return (Bytecodes::JMP == bytecode) || (Bytecodes::JMPE == bytecode)
+        || (Bytecodes::JMPL == bytecode) || (Bytecodes::JMPG == bytecode);
+}
+
+bool ELOptimizer::endsBlock(Bytecodes bytecode) {
+    return (Bytecodes::JMP == bytecode) || (Bytecodes::RET == bytecode) || (Bytecodes::HALT == bytecode);
+}
+
+void ELOptimizer::optimize(Function *function) {
+    load(function);
+    for (int iteration = 0; iteration < MAX_ITERATIONS; iteration++) {
+        bool changed = false;
+        findJumpTargets();
+        changed |= foldConstants();
+        compact();
+        findJumpTargets();
+        changed |= threadJumps();
+        compact();
+        findJumpTargets();
+        changed |= removeUnreachable();
+        compact();
+        findJumpTargets();
+        changed |= simplifySequences();
+        compact();
+        if (_level >= 2) {
+            findJumpTargets();
+            changed |= propagateCopies();
+            compact();
+            findJumpTargets();
+            changed |= removeDeadStores();
+            compact();
+        }
+        if (!changed) {
+            break;
+        }
+    }
+    store(function);
+}
+
+void ELOptimizer::load(Function *function) {
+    const vector<Instruction *> &instructions = function->getInstructions();
+    map<int64_t, int64_t> offsetToIndex;
+    int64_t offset = 0;
+    _code.clear();
+    for (size_t i = 0; i < instructions.size(); i++) {
+        Instruction *instruction = instructions[i];
+        OptimizerInstruction entry;
+        entry.bytecode = instruction->getBytecode();
+        entry.arg = 0;
+        entry.target = -1;
+        entry.instruction = instruction;
+        entry.deleted = false;
+        switch (entry.bytecode) {
+        case Bytecodes::PUSH_CONSTANT:
+        case Bytecodes::PUSH_ARG:
+        case Bytecodes::PUSH_LOCAL:
+        case Bytecodes::POP_LOCAL:
+            entry.arg = ((OneArgInstruction *)instruction)->getArg();
+            break;
+        case Bytecodes::JMP:
+        case Bytecodes::JMPE:
+        case Bytecodes::JMPL:
+        case Bytecodes::JMPG:
+            entry.arg = ((JumpInstruction *)instruction)->getTarget();
+            break;
+        default:
+            break;
+        }
+        offsetToIndex[offset] = i;
+        offset += instruction->encodingLength();
+        _code.push_back(entry);
+    }
+    offsetToIndex[offset] = _code.size();
+
+    for (size_t i = 0; i < _code.size(); i++) {
+        if (isJump(_code[i].bytecode)) {
+            _code[i].target = offsetToIndex[_code[i].arg];
+            _code[i].arg = 0;
+        }
+    }
+    const map<string, int64_t> &labels = function->getLabels();
+    for (map<string, int64_t>::const_iterator it = labels.begin(); it != labels.end(); ++it) {
+        int64_t index = offsetToIndex[it->second];
+        if ((index < (int64_t)_code.size()) && _code[index].label.empty()) {
+            _code[index].label = it->first;
+        }
+    }
+}
+
+void ELOptimizer::store(Function *function) {
+    int64_t count = _code.size();
+    string endLabel;
+    for (int64_t i = 0; i < count; i++) {
+        if (!isJump(_code[i].bytecode)) {
+            continue;
+        }
+        /* a target whose label went away with the code it was on gets a name nobody can write in source */
+        int64_t target = _code[i].target;
+        if (target == count) {
+            endLabel = "$end";
+        } else if (_code[target].label.empty()) {
+            _code[target].label = "$" + to_string(target);
+        }
+    }
+
+    vector<Instruction *> instructions;
+    vector<int64_t> offsets;
+    int64_t offset = 0;
+    for (int64_t i = 0; i < count; i++) {
+        OptimizerInstruction *entry = &_code[i];
+        Instruction *instruction = entry->instruction;
+        if (isJump(entry->bytecode)) {
+            const string &label = (entry->target == count) ? endLabel : _code[entry->target].label;
+            instruction = _listener->createInstruction<JumpInstruction>(entry->bytecode, label);
+        } else if (nullptr == instruction) {
+            switch (entry->bytecode) {
+            case Bytecodes::PUSH_CONSTANT:
+            case Bytecodes::PUSH_ARG:
+            case Bytecodes::PUSH_LOCAL:
+            case Bytecodes::POP_LOCAL:
+                instruction = _listener->createInstruction<OneArgInstruction>(entry->bytecode, entry->arg);
+                break;
+            default:
+                instruction = _listener->createInstruction<Instruction>(entry->bytecode);
+                break;
+            }
+        }
+        offsets.push_back(offset);
+        offset += instruction->encodingLength();
+        instructions.push_back(instruction);
+    }
+    offsets.push_back(offset);
+
+    map<string, int64_t> labels;
+    for (int64_t i = 0; i < count; i++) {
+        if (!_code[i].label.empty()) {
+            labels[_code[i].label] = offsets[i];
+        }
+        if (isJump(_code[i].bytecode)) {
+            ((JumpInstruction *)instructions[i])->setTarget(offsets[_code[i].target]);
+        }
+    }
+    if (!endLabel.empty()) {
+        labels[endLabel] = offset;
+    }
+    function->replaceInstructions(instructions, labels);
+    _code.clear();
+}
+
+/* drops deleted entries; a jump to a deleted entry lands on whatever followed it */
+void ELOptimizer::compact() {
+    int64_t count = _code.size();
+    vector<int64_t> remap(count + 1);
+    vector<OptimizerInstruction> code;
+    string pendingLabel;
+    for (int64_t i = 0; i < count; i++) {
+        remap[i] = code.size();
+        if (_code[i].deleted) {
+            if (pendingLabel.empty()) {
+                pendingLabel = _code[i].label;
+            }
+            continue;
+        }
+        if (_code[i].label.empty()) {
+            _code[i].label = pendingLabel;
+        }
+        pendingLabel.clear();
+        code.push_back(_code[i]);
+    }
+    remap[count] = code.size();
+    for (size_t i = 0; i < code.size(); i++) {
+        if (isJump(code[i].bytecode)) {
+            code[i].target = remap[code[i].target];
+        }
+    }
+    _code.swap(code);
+}
+
+void ELOptimizer::findJumpTargets() {
+    _isJumpTarget.assign(_code.size() + 1, false);
+    for (size_t i = 0; i < _code.size(); i++) {
+        if (isJump(_code[i].bytecode)) {
+            _isJumpTarget[_code[i].target] = true;
+        }
+    }
+}
+
+/* true when first..last can be rewritten together: present and only entered at first */
+bool ELOptimizer::inBlock(int64_t first, int64_t last) {
+    if (last >= (int64_t)_code.size()) {
+        return false;
+    }
+    for (int64_t i = first; i <= last; i++) {
+        if (_code[i].deleted || ((i > first) && _isJumpTarget[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ELOptimizer::rewrite(int64_t index, Bytecodes bytecode, int64_t arg) {
+    _code[index].bytecode = bytecode;
+    _code[index].arg = arg;
+    _code[index].instruction = nullptr;
+}
+
+void ELOptimizer::remove(int64_t index) {
+    _code[index].deleted = true;
+}
+
+bool ELOptimizer::foldConstants() {
+    bool changed = false;
+    for (int64_t i = 0; i < (int64_t)_code.size(); i++) {
+        if ((Bytecodes::PUSH_CONSTANT != _code[i].bytecode) || !inBlock(i, i + 2)
+            || (Bytecodes::PUSH_CONSTANT != _code[i + 1].bytecode)) {
+            continue;
+        }
+        int64_t left = _code[i].arg;
+        int64_t right = _code[i + 1].arg;
+        Bytecodes operation = _code[i + 2].bytecode;
+        int64_t result = 0;
+        bool taken = false;
+        switch (operation) {
+        /* wrap the way the engines do without relying on signed overflow here */
+        case Bytecodes::ADD:
+            result = (int64_t)((uint64_t)left + (uint64_t)right);
+            break;
+        case Bytecodes::SUB:
+            result = (int64_t)((uint64_t)left - (uint64_t)right);
+            break;
+        case Bytecodes::MUL:
+            result = (int64_t)((uint64_t)left * (uint64_t)right);
+            break;
+        case Bytecodes::DIV:
+        case Bytecodes::MOD:
+            /* leave the trap to run time */
+            if ((0 == right) || ((INT64_MIN == left) && (-1 == right))) {
+                continue;
+            }
+            result = (Bytecodes::DIV == operation) ? (left / right) : (left % right);
+            break;
+        case Bytecodes::JMPE:
+            taken = (left == right);
+            break;
+        case Bytecodes::JMPL:
+            taken = (left < right);
+            break;
+        case Bytecodes::JMPG:
+            taken = (left > right);
+            break;
+        default:
+            continue;
+        }
+
+        if (isJump(operation)) {
+            if (taken) {
+                rewrite(i, Bytecodes::JMP, 0);
+                _code[i].target = _code[i + 2].target;
+            } else {
+                remove(i);
+            }
+        } else {
+            rewrite(i, Bytecodes::PUSH_CONSTANT, result);
+        }
+        remove(i + 1);
+        remove(i + 2);
+        changed = true;
+        i += 2;
+    }
+    return changed;
+}
+
+bool ELOptimizer::threadJumps() {
+    bool changed = false;
+    int64_t count = _code.size();
+    for (int64_t i = 0; i < count; i++) {
+        if (!isJump(_code[i].bytecode)) {
+            continue;
+        }
+        int64_t target = _code[i].target;
+        for (int64_t hops = 0; (hops < count) && (target < count) && (Bytecodes::JMP == _code[target].bytecode); hops++) {
+            target = _code[target].target;
+        }
+        if (target != _code[i].target) {
+            _code[i].target = target;
+            changed = true;
+        }
+
+        if (Bytecodes::JMP != _code[i].bytecode) {
+            continue;
+        }
+        if (target == i + 1) {
+            remove(i);
+            changed = true;
+        } else if ((target < count) && ((Bytecodes::RET == _code[target].bytecode) || (Bytecodes::HALT == _code[target].bytecode))) {
+            /* the stack at the target is the stack here, so returning directly is the same */
+            rewrite(i, _code[target].bytecode, 0);
+            _code[i].target = -1;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool ELOptimizer::removeUnreachable() {
+    int64_t count = _code.size();
+    vector<bool> reached(count, false);
+    vector<int64_t> worklist;
+    if (count > 0) {
+        worklist.push_back(0);
+    }
+    while (!worklist.empty()) {
+        int64_t i = worklist.back();
+        worklist.pop_back();
+        if ((i >= count) || reached[i]) {
+            continue;
+        }
+        reached[i] = true;
+        if (isJump(_code[i].bytecode)) {
+            worklist.push_back(_code[i].target);
+        }
+        if (!endsBlock(_code[i].bytecode)) {
+            worklist.push_back(i + 1);
+        }
+    }
+
+    bool changed = false;
+    for (int64_t i = 0; i < count; i++) {
+        if (!reached[i]) {
+            remove(i);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool ELOptimizer::simplifySequences() {
+    bool changed = false;
+    for (int64_t i = 0; i < (int64_t)_code.size(); i++) {
+        Bytecodes bytecode = _code[i].bytecode;
+        if (Bytecodes::NOP == bytecode) {
+            remove(i);
+            changed = true;
+            continue;
+        }
+        if (!inBlock(i, i + 1)) {
+            continue;
+        }
+        Bytecodes next = _code[i + 1].bytecode;
+
+        /* a value pushed only to be popped again */
+        bool pushesValue = (Bytecodes::PUSH_CONSTANT == bytecode) || (Bytecodes::PUSH_ARG == bytecode)
+            || (Bytecodes::PUSH_LOCAL == bytecode) || (Bytecodes::DUP == bytecode) || (Bytecodes::CURRENT_TIME == bytecode);
+        if (pushesValue && (Bytecodes::POP == next)) {
+            remove(i);
+            remove(i + 1);
+            changed = true;
+            i += 1;
+            continue;
+        }
+
+        /* x+0, x-0, x*1 and x/1 leave x on the stack */
+        if ((Bytecodes::PUSH_CONSTANT == bytecode)
+            && (((0 == _code[i].arg) && ((Bytecodes::ADD == next) || (Bytecodes::SUB == next)))
+                || ((1 == _code[i].arg) && ((Bytecodes::MUL == next) || (Bytecodes::DIV == next))))) {
+            remove(i);
+            remove(i + 1);
+            changed = true;
+            i += 1;
+            continue;
+        }
+
+        if ((Bytecodes::DUP == bytecode) && (Bytecodes::POP_LOCAL == next)
+            && inBlock(i, i + 2) && (Bytecodes::POP == _code[i + 2].bytecode)) {
+            remove(i);
+            remove(i + 2);
+            changed = true;
+            i += 2;
+        }
+    }
+    return changed;
+}
+
+/* Within a block, remembers which locals hold a constant, an argument or a
+ * copy of another local, and reads the source instead. A store directly
+ * followed by a load of the same local becomes DUP and the store.
+ */
+bool ELOptimizer::propagateCopies() {
+    typedef struct KnownValue {
+        Bytecodes source;
+        int64_t value;
+    } KnownValue;
+    map<int64_t, KnownValue> known;
+    bool changed = false;
+    for (int64_t i = 0; i < (int64_t)_code.size(); i++) {
+        if (_isJumpTarget[i]) {
+            known.clear();
+        }
+        OptimizerInstruction *entry = &_code[i];
+        if (Bytecodes::PUSH_LOCAL == entry->bytecode) {
+            map<int64_t, KnownValue>::iterator found = known.find(entry->arg);
+            if (found != known.end()) {
+                rewrite(i, found->second.source, found->second.value);
+                changed = true;
+            }
+        } else if (Bytecodes::POP_LOCAL == entry->bytecode) {
+            int64_t local = entry->arg;
+            known.erase(local);
+            for (map<int64_t, KnownValue>::iterator it = known.begin(); it != known.end(); ) {
+                if ((Bytecodes::PUSH_LOCAL == it->second.source) && (local == it->second.value)) {
+                    it = known.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            OptimizerInstruction *previous = (i > 0) ? &_code[i - 1] : nullptr;
+            if ((nullptr != previous) && !_isJumpTarget[i]
+                && ((Bytecodes::PUSH_CONSTANT == previous->bytecode) || (Bytecodes::PUSH_ARG == previous->bytecode)
+                    || ((Bytecodes::PUSH_LOCAL == previous->bytecode) && (local != previous->arg)))) {
+                KnownValue value = { previous->bytecode, previous->arg };
+                known[local] = value;
+            } else if (inBlock(i, i + 1) && (Bytecodes::PUSH_LOCAL == _code[i + 1].bytecode) && (local == _code[i + 1].arg)) {
+                rewrite(i, Bytecodes::DUP, 0);
+                rewrite(i + 1, Bytecodes::POP_LOCAL, local);
+                changed = true;
+                i += 1;
+            }
+        } else if (endsBlock(entry->bytecode)) {
+            known.clear();
+        }
+    }
+    return changed;
+}
+
+/* Stores to locals nobody reads afterwards become plain pops, which
+ * simplifySequences then usually removes along with the value.
+ */
+bool ELOptimizer::removeDeadStores() {
+    int64_t count = _code.size();
+    int64_t localSlots = 0;
+    for (int64_t i = 0; i < count; i++) {
+        if ((Bytecodes::PUSH_LOCAL == _code[i].bytecode) || (Bytecodes::POP_LOCAL == _code[i].bytecode)) {
+            localSlots = max(localSlots, _code[i].arg + 1);
+        }
+    }
+    if (0 == localSlots) {
+        return false;
+    }
+
+    vector<int64_t> blockStarts;
+    vector<int64_t> blockOf(count + 1);
+    for (int64_t i = 0; i < count; i++) {
+        if ((0 == i) || _isJumpTarget[i] || isJump(_code[i - 1].bytecode) || endsBlock(_code[i - 1].bytecode)) {
+            blockStarts.push_back(i);
+        }
+        blockOf[i] = blockStarts.size() - 1;
+    }
+    int64_t blockCount = blockStarts.size();
+    blockOf[count] = blockCount;
+    blockStarts.push_back(count);
+
+    vector<vector<bool> > used(blockCount, vector<bool>(localSlots, false));
+    vector<vector<bool> > defined(blockCount, vector<bool>(localSlots, false));
+    vector<vector<bool> > liveIn(blockCount, vector<bool>(localSlots, false));
+    vector<vector<bool> > liveOut(blockCount, vector<bool>(localSlots, false));
+    for (int64_t block = 0; block < blockCount; block++) {
+        for (int64_t i = blockStarts[block]; i < blockStarts[block + 1]; i++) {
+            int64_t local = _code[i].arg;
+            if ((Bytecodes::PUSH_LOCAL == _code[i].bytecode) && !defined[block][local]) {
+                used[block][local] = true;
+            } else if (Bytecodes::POP_LOCAL == _code[i].bytecode) {
+                defined[block][local] = true;
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int64_t block = blockCount - 1; block >= 0; block--) {
+            int64_t last = blockStarts[block + 1] - 1;
+            vector<bool> out(localSlots, false);
+            int64_t successors[2];
+            int64_t successorCount = 0;
+            if (isJump(_code[last].bytecode)) {
+                successors[successorCount++] = blockOf[_code[last].target];
+            }
+            if (!endsBlock(_code[last].bytecode)) {
+                successors[successorCount++] = block + 1;
+            }
+            for (int64_t s = 0; s < successorCount; s++) {
+                if (successors[s] >= blockCount) {
+                    continue;
+                }
+                for (int64_t local = 0; local < localSlots; local++) {
+                    if (liveIn[successors[s]][local]) {
+                        out[local] = true;
+                    }
+                }
+            }
+            for (int64_t local = 0; local < localSlots; local++) {
+                bool in = used[block][local] || (out[local] && !defined[block][local]);
+                if (in != liveIn[block][local]) {
+                    liveIn[block][local] = in;
+                    changed = true;
+                }
+            }
+            liveOut[block] = out;
+        }
+    }
+
+    bool removed = false;
+    for (int64_t block = 0; block < blockCount; block++) {
+        vector<bool> live = liveOut[block];
+        for (int64_t i = blockStarts[block + 1] - 1; i >= blockStarts[block]; i--) {
+            int64_t local = _code[i].arg;
+            if (Bytecodes::PUSH_LOCAL == _code[i].bytecode) {
+                live[local] = true;
+            } else if (Bytecodes::POP_LOCAL == _code[i].bytecode) {
+                if (!live[local]) {
+                    rewrite(i, Bytecodes::POP, 0);
+                    removed = true;
+                }
+                live[local] = false;
+            }
+        }
+    }
+    return removed;
+}
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifndef ELOPTIMIZER_INCL
+#define ELOPTIMIZER_INCL
+
+using namespace std;
+
+/* Rewrites a Function's instruction list before it is encoded. Level 1 folds
+ * constants, threads jumps, drops unreachable code and simplifies stack
+ * neutral sequences. Level 2 adds copy propagation and dead store elimination
+ * over locals. Every rewrite keeps the stack depth at each jump target what it
+ * was, so the loader's verifier accepts the result.
+ */
+class ELOptimizer {
+public:
+    ELOptimizer(MyListener *listener, int64_t level) :
+        _listener(listener),
+        _level(level),
+        _code(),
+        _isJumpTarget()
+    {}
+    void optimize(Function *function);
+
+private:
+    /* jumps refer to instructions by index so passes can delete freely */
+    typedef struct OptimizerInstruction {
+        Bytecodes bytecode;
+        int64_t arg;
+        int64_t target;
+        string label;
+        Instruction *instruction; /* the original, null once rewritten */
+        bool deleted;
+    } OptimizerInstruction;
+
+    /* upper bound on how many times the passes run over one function */
+    static const int MAX_ITERATIONS = 16;
+
+    void load(Function *function);
+    void store(Function *function);
+    void compact();
+    void findJumpTargets();
+    bool inBlock(int64_t first, int64_t last);
+    void rewrite(int64_t index, Bytecodes bytecode, int64_t arg);
+    void remove(int64_t index);
+
+    bool foldConstants();
+    bool threadJumps();
+    bool removeUnreachable();
+    bool simplifySequences();
+    bool propagateCopies();
+    bool removeDeadStores();
+
+    static bool isJump(Bytecodes bytecode);
+    static bool endsBlock(Bytecodes bytecode);
+
+    MyListener *_listener;
+    int64_t _level;
+    vector<OptimizerInstruction> _code;
+    vector<bool> _isJumpTarget;
+};
+
+#endif /* ELOPTIMIZER_INCL */
@@ -0,0 +1,198 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cctype>
+
+#include "antlr4-runtime.h"
+#include "ELParser.h"
+#include "ELBaseListener.h"
+#include "Bytecodes.hpp"
+#include "BytecodeCompiler.hpp"
+#include "ELStreamParser.hpp"
+
+bool ELStreamParser::parseProgram() {
+    Token programName = next();
+    if ((TOKEN_NAME != programName.type) || isKeyword(programName)) {
+        return error(programName, "a program name");
+    }
+    _listener->setProgramName(programName.text);
+
+    if (TOKEN_END_OF_FILE == peek(0).type) {
+        return error(peek(0), "DEF");
+    }
+    while (TOKEN_END_OF_FILE != peek(0).type) {
+        if (!parseFunction()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ELStreamParser::parseFunction() {
+    Token def = next();
+    if ((TOKEN_NAME != def.type) || (0 != def.text.compare("DEF"))) {
+        return error(def, "DEF");
+    }
+    Token functionName = next();
+    if ((TOKEN_NAME != functionName.type) || isKeyword(functionName)) {
+        return error(functionName, "a function name");
+    }
+    Token argCount = next();
+    if (TOKEN_INT != argCount.type) {
+        return error(argCount, "an argument count");
+    }
+
+    Function *function = _listener->addFunction(functionName.text, (int64_t)atol(argCount.text.c_str()));
+    if (isEnd(peek(0))) {
+        return error(peek(0), "an instruction");
+    }
+    while (!isEnd(peek(0))) {
+        if (!parseInstruction(function)) {
+            return false;
+        }
+    }
+    next();
+    function->resolveLabels();
+    return true;
+}
+
+bool ELStreamParser::parseInstruction(Function *function) {
+    Token first = next();
+    if (TOKEN_NAME != first.type) {
+        return error(first, "an instruction or label");
+    }
+    if (!isKeyword(first)) {
+        if (TOKEN_COLON != peek(0).type) {
+            return error(peek(0), "':' after a label name");
+        }
+        next();
+        function->addLabel(first.text);
+        return true;
+    }
+
+    Bytecodes bytecode = Bytecode::getBytecode(first.text);
+    if (Bytecodes::ERROR == bytecode) {
+        return error(first, "an instruction or label");
+    }
+
+    Instruction *ins = nullptr;
+    Token &operand = peek(0);
+    if (TOKEN_INT == operand.type) {
+        ins = _listener->createInstruction<OneArgInstruction>(bytecode, (int64_t)atol(next().text.c_str()));
+    } else if (TOKEN_STRING == operand.type) {
+        ins = _listener->createInstruction<PrintStringInstruction>(bytecode, next().text);
+    } else if ((TOKEN_NAME == operand.type) && !isKeyword(operand) && (TOKEN_COLON != peek(1).type)) {
+        string name = next().text;
+        if (TOKEN_INT == peek(0).type) {
+            ins = _listener->createInstruction<CallInstruction>(bytecode, name, (int64_t)atol(next().text.c_str()));
+        } else {
+            ins = _listener->createInstruction<JumpInstruction>(bytecode, name);
+        }
+    } else {
+        /* either another instruction or a label follows */
+        ins = _listener->createInstruction<Instruction>(bytecode);
+    }
+    function->addInstruction(ins);
+    return true;
+}
+
+bool ELStreamParser::isKeyword(const Token &token) {
+    if (TOKEN_NAME != token.type) {
+        return false;
+    }
+    return (0 == token.text.compare("DEF")) || (0 == token.text.compare("end")) || (Bytecodes::ERROR != Bytecode::getBytecode(token.text));
+}
+
+ELStreamParser::Token &ELStreamParser::peek(int distance) {
+    while (_tokenCount <= distance) {
+        lex(&_tokens[_tokenCount++]);
+    }
+    return _tokens[distance];
+}
+
+ELStreamParser::Token ELStreamParser::next() {
+    peek(0);
+    Token token = std::move(_tokens[0]);
+    for (int i = 1; i < _tokenCount; i++) {
+        _tokens[i - 1] = std::move(_tokens[i]);
+    }
+    _tokenCount -= 1;
+    return token;
+}
+
+void ELStreamParser::lex(Token *token) {
+    int c = _buffer->sgetc();
+    while (true) {
+        if ((' ' == c) || ('\t' == c) || ('\r' == c)) {
+            c = _buffer->snextc();
+        } else if ('\n' == c) {
+            _line += 1;
+            c = _buffer->snextc();
+        } else if ('/' == c) {
+            if ('/' != _buffer->snextc()) {
+                token->type = TOKEN_INVALID;
+                token->text = "/";
+                token->line = _line;
+                return;
+            }
+            while ((EOF != c) && ('\r' != c) && ('\n' != c)) {
+                c = _buffer->snextc();
+            }
+        } else {
+            break;
+        }
+    }
+
+    token->line = _line;
+    token->text.clear();
+    if (EOF == c) {
+        token->type = TOKEN_END_OF_FILE;
+    } else if (isdigit(c)) {
+        token->type = TOKEN_INT;
+        while ((EOF != c) && isdigit(c)) {
+            token->text.push_back((char)c);
+            c = _buffer->snextc();
+        }
+    } else if (isalpha(c)) {
+        token->type = TOKEN_NAME;
+        while ((EOF != c) && (isalnum(c) || ('_' == c))) {
+            token->text.push_back((char)c);
+            c = _buffer->snextc();
+        }
+    } else if ('"' == c) {
+        token->type = TOKEN_STRING;
+        token->text.push_back((char)c);
+        c = _buffer->snextc();
+        while ((EOF != c) && ('"' != c)) {
+            if ('\n' == c) {
+                _line += 1;
+            }
+            token->text.push_back((char)c);
+            c = _buffer->snextc();
+        }
+        if (EOF == c) {
+            token->type = TOKEN_INVALID;
+            return;
+        }
+        token->text.push_back((char)c);
+        _buffer->sbumpc();
+    } else if (':' == c) {
+        token->type = TOKEN_COLON;
+        token->text.push_back((char)c);
+        _buffer->sbumpc();
+    } else {
+        token->type = TOKEN_INVALID;
+        token->text.push_back((char)c);
+        _buffer->sbumpc();
+    }
+}
+
+bool ELStreamParser::error(const Token &token, const char *expected) {
+    cerr << "Error: line " << token.line << ": expected " << expected << " but found ";
+    if (TOKEN_END_OF_FILE == token.type) {
+        cerr << "end of file" << endl;
+    } else {
+        cerr << "'" << token.text << "'" << endl;
+    }
+    return false;
+}
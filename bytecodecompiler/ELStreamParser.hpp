@@ -0,0 +1,56 @@
+#include <iostream>
+#include <string>
+
+#ifndef ELSTREAMPARSER_INCL
+#define ELSTREAMPARSER_INCL
+
+using namespace std;
+
+/* Single pass front end for EL source. It lexes the input a character at a
+ * time and hands MyListener the same functions and instructions the ANTLR
+ * parse tree walk does, without building a tree first.
+ */
+class ELStreamParser {
+public:
+    ELStreamParser(istream *stream, MyListener *listener) :
+        _buffer(stream->rdbuf()),
+        _listener(listener),
+        _line(1),
+        _tokenCount(0)
+    {}
+    bool parseProgram();
+
+private:
+    enum TokenType {
+        TOKEN_END_OF_FILE,
+        TOKEN_INT,
+        TOKEN_NAME,
+        TOKEN_STRING,
+        TOKEN_COLON,
+        TOKEN_INVALID
+    };
+    typedef struct Token {
+        TokenType type;
+        string text;
+        int64_t line;
+    } Token;
+    /* a call needs to see past its callee name to tell it apart from a jump */
+    static const int LOOKAHEAD = 2;
+
+    Token &peek(int distance);
+    Token next();
+    void lex(Token *token);
+    bool isKeyword(const Token &token);
+    bool isEnd(const Token &token) { return (TOKEN_NAME == token.type) && (0 == token.text.compare("end")); }
+    bool parseFunction();
+    bool parseInstruction(Function *function);
+    bool error(const Token &token, const char *expected);
+
+    streambuf *_buffer;
+    MyListener *_listener;
+    int64_t _line;
+    Token _tokens[LOOKAHEAD];
+    int _tokenCount;
+};
+
+#endif /* ELSTREAMPARSER_INCL */
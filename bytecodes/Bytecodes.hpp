@@ -109,10 +109,70 @@ public:
     static int32_t getBytecodeAsInt(Bytecodes bytecode) {
         return static_cast<int32_t>(bytecode);
     }
+    static int64_t getBytecodeLength(Bytecodes bytecode) {
+        switch (bytecode) {
+        case Bytecodes::PUSH_CONSTANT:
+        case Bytecodes::PUSH_ARG:
+        case Bytecodes::PUSH_LOCAL:
+        case Bytecodes::POP_LOCAL:
+        case Bytecodes::JMP:
+        case Bytecodes::JMPE:
+        case Bytecodes::JMPL:
+        case Bytecodes::JMPG:
+        case Bytecodes::PRINT_STRING:
+            return 9;
+        case Bytecodes::CALL:
+            return 17;
+        default:
+            return 1;
+        }
+    }
 
 private:
     static const char* bytecodeNames[];
 };
 
+/* Version 0 .le files have the program name length straight after the opening
+ * eyecatcher. Later versions put FORMAT_VERSION_MARKER | version and a flags
+ * byte there first, which can not be confused with a name length as those are
+ * limited to 127.
+ *
+ * Version 1 (compact) encodes instruction operands as LEB128 varints instead
+ * of 8 byte big endian values. Constants and jump operands are zigzag encoded
+ * and jumps are relative to the start of the jump instruction. Offsets are in
+ * the loaded (canonical) layout, which is what getBytecodeLength describes, so
+ * the loader expands compact bodies back to that layout and nothing after the
+ * loader has to know about the file encoding. Each function header carries the
+ * canonical size followed by the encoded size of its body.
+ *
+ * Version 2 is version 1 with the program name length, function count and
+ * function name lengths written as LEB128 varints rather than a signed byte,
+ * which lifts the 127 function and 127 character limits.
+ */
+#define FORMAT_VERSION_MARKER 0x80
+#define FORMAT_VERSION_0 0
+#define FORMAT_VERSION_COMPACT 1
+#define FORMAT_VERSION_VARINT_COUNTS 2
+#define FORMAT_VERSION_CURRENT FORMAT_VERSION_VARINT_COUNTS
+
+/* Format flags, version 1 and later.
+ *
+ * FORMAT_FLAG_NATIVE stores function bodies in the loaded layout instead of
+ * the compact encoding: native byte order immediates, each body starting on
+ * an 8 byte file offset. Names are followed by a NUL byte. A loader on a
+ * matching host can use names, opcodes and string data straight out of the
+ * file image. FORMAT_FLAG_BIG_ENDIAN records the byte order of such a file.
+ */
+#define FORMAT_FLAG_NATIVE 0x01
+#define FORMAT_FLAG_BIG_ENDIAN 0x02
+/* FORMAT_FLAG_FUNCTION_DIRECTORY puts a directory entry for every function
+ * (name, ID, arg count, opcode count, encoded size, max stack depth, local
+ * count, absolute body offset) ahead of the bodies, followed by the absolute
+ * offset of the string table. Bodies are then only loaded and verified when
+ * a function is first called.
+ */
+#define FORMAT_FLAG_FUNCTION_DIRECTORY 0x04
+#define FORMAT_NATIVE_BODY_ALIGNMENT 8
+
 #endif /* BYTECODES_INCL */
 
@@ -0,0 +1,93 @@
+TestDirectCalls
+
+// outer is called 30 times and calls three small functions, so once the
+// JIT has compiled them outer's body calls them directly, through their
+// compiledFunction cell or back into the interpreter, depending on how far
+// each has tiered up. Every path has to print the same values.
+
+DEF main 0
+	PUSH_CONSTANT 0
+	POP_LOCAL 1
+LOOP:
+	PUSH_LOCAL 1
+	CALL outer 1
+	PRINT_INT64
+	PRINT_STRING "\n"
+	PUSH_LOCAL 1
+	PUSH_CONSTANT 1
+	ADD
+	DUP
+	POP_LOCAL 1
+	PUSH_CONSTANT 30
+	JMPL LOOP
+	PUSH_CONSTANT 0
+	RET
+end
+
+DEF outer 1
+	PUSH_ARG 0
+	PUSH_CONSTANT 3
+	CALL add2 2
+	PUSH_ARG 0
+	CALL sumto 1
+	ADD
+	PUSH_ARG 0
+	PUSH_CONSTANT 7
+	ADD
+	CALL mod3 1
+	ADD
+	PUSH_ARG 0
+	DUP
+	MUL
+	ADD
+	RET
+end
+
+DEF add2 2
+	PUSH_ARG 0
+	PUSH_ARG 1
+	ADD
+	RET
+end
+
+// returns the sum of 0 to n - 1
+DEF sumto 1
+	PUSH_CONSTANT 0
+	POP_LOCAL 0
+	PUSH_CONSTANT 0
+	POP_LOCAL 1
+	PUSH_ARG 0
+	PUSH_CONSTANT 1
+	JMPL DONE
+TOP:
+	PUSH_LOCAL 0
+	PUSH_LOCAL 1
+	ADD
+	POP_LOCAL 0
+	PUSH_LOCAL 1
+	PUSH_CONSTANT 1
+	ADD
+	DUP
+	POP_LOCAL 1
+	PUSH_ARG 0
+	JMPL TOP
+DONE:
+	PUSH_LOCAL 0
+	RET
+end
+
+// takes 3 away from n until it is at most 2
+DEF mod3 1
+	PUSH_ARG 0
+	POP_LOCAL 0
+TOP:
+	PUSH_LOCAL 0
+	PUSH_CONSTANT 3
+	SUB
+	DUP
+	POP_LOCAL 0
+	PUSH_CONSTANT 2
+	JMPG TOP
+	PUSH_LOCAL 0
+	RET
+end
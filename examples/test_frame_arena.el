@@ -0,0 +1,49 @@
+TestFrameArena
+
+// rec uses 21 locals so its frames do not fit in the inline frame data and
+// come from the VM stack arena. 2000 calls 40 deep need more slots than the
+// arena has, so every frame has to give its slots back on return.
+// should print 1640000
+DEF main 0
+	PUSH_CONSTANT 0
+	POP_LOCAL 1
+	PUSH_CONSTANT 0
+	POP_LOCAL 2
+LOOP:
+	PUSH_CONSTANT 40
+	CALL rec 1
+	PUSH_LOCAL 2
+	ADD
+	POP_LOCAL 2
+	PUSH_LOCAL 1
+	PUSH_CONSTANT 1
+	ADD
+	DUP
+	POP_LOCAL 1
+	PUSH_CONSTANT 2000
+	JMPL LOOP
+	PUSH_LOCAL 2
+	PRINT_INT64
+	PRINT_STRING "\n"
+	PUSH_CONSTANT 0
+	RET
+end
+
+// returns the sum of 1 to n
+DEF rec 1
+	PUSH_ARG 0
+	POP_LOCAL 20
+	PUSH_ARG 0
+	PUSH_CONSTANT 1
+	JMPL BASE
+	PUSH_ARG 0
+	PUSH_CONSTANT 1
+	SUB
+	CALL rec 1
+	PUSH_LOCAL 20
+	ADD
+	RET
+BASE:
+	PUSH_LOCAL 20
+	RET
+end
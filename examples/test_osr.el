@@ -0,0 +1,50 @@
+TestOSR
+
+// main's loop runs long enough to get compiled for OSR part way through, so
+// the compiled body has to pick up every local from the interpreted frame.
+// Local 3 is only written before the loop and only read inside and after it.
+// should print 87482500 590057 7
+DEF main 0
+	PUSH_CONSTANT 7
+	POP_LOCAL 3
+	PUSH_CONSTANT 0
+	POP_LOCAL 0
+	PUSH_CONSTANT 0
+	POP_LOCAL 1
+	PUSH_CONSTANT 1
+	POP_LOCAL 2
+LOOP:
+	// sum = sum + i * local 3
+	PUSH_LOCAL 1
+	PUSH_LOCAL 0
+	PUSH_LOCAL 3
+	MUL
+	ADD
+	POP_LOCAL 1
+	// x = x * 3 % 1000003
+	PUSH_LOCAL 2
+	PUSH_CONSTANT 3
+	MUL
+	PUSH_CONSTANT 1000003
+	MOD
+	POP_LOCAL 2
+	PUSH_LOCAL 0
+	PUSH_CONSTANT 1
+	ADD
+	DUP
+	POP_LOCAL 0
+	PUSH_CONSTANT 5000
+	JMPL LOOP
+
+	PUSH_LOCAL 1
+	PRINT_INT64
+	PRINT_STRING " "
+	PUSH_LOCAL 2
+	PRINT_INT64
+	PRINT_STRING " "
+	PUSH_LOCAL 3
+	PRINT_INT64
+	PRINT_STRING "\n"
+	PUSH_CONSTANT 0
+	RET
+end
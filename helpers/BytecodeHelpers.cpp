@@ -28,14 +28,19 @@
 #include <cstring>
 #include <cstddef>
 
+#include <inttypes.h>
 #include <time.h>
 #include <sys/time.h>
 
 #include "JitBuilder.hpp"
 #include "BytecodeHelpers.hpp"
+#include "Helpers.hpp"
+#include "CompileQueue.hpp"
+#include "TieringPolicy.hpp"
 
 #include "InterpreterTypeDictionary.hpp"
 #include "CMInterpreterMethod.hpp"
+#include "IBInterpreter.hpp"
 
 #include "EL.hpp"
 
@@ -63,9 +68,12 @@ IlValue *peek(RuntimeBuilder *rb, IlBuilder *builder) {
     return state->_stack->Top(builder);
 }
 
+/* a merge StoreOvers every slot that differs, so no two slots may share an IlValue
+ * or the store meant for one also changes the other. Values that are already in a
+ * slot get copied before they go into another one */
 void dup(RuntimeBuilder *rb, IlBuilder *builder) {
     InterpreterVMState *state = (InterpreterVMState *)rb->GetVMState(builder);
-    state->_stack->Dup(builder);
+    state->_stack->Push(builder, builder->Copy(state->_stack->Top(builder)));
 }
 
 IlValue *getArg(RuntimeBuilder *rb, IlBuilder *builder, IlValue *argIndex) {
@@ -80,23 +88,142 @@ IlValue *getLocal(RuntimeBuilder *rb, IlBuilder *builder, IlValue *localIndex) {
 
 void setLocal(RuntimeBuilder *rb, IlBuilder *builder, IlValue *localIndex, IlValue *value) {
     InterpreterVMState *state = (InterpreterVMState *)rb->GetVMState(builder);
-    state->_locals->Set(builder, localIndex, value);
+    state->_locals->Set(builder, localIndex, builder->Copy(value));
 }
 
 void compileFunction(VM *vm, Function *function) {
+    int64_t expected = COMPILE_NOT_STARTED;
+    if (!__atomic_compare_exchange_n(&function->compileState, &expected, COMPILE_QUEUED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    if (nullptr != vm->compileQueue) {
+        vm->compileQueue->enqueue(function, -1, JIT_LEVEL_WARM);
+    } else {
+        compileFunctionSynchronously(vm, function, JIT_LEVEL_WARM);
+    }
+}
+
+/* called by warm bodies once their own counters say the function is hot */
+void recompileFunction(VM *vm, Function *function) {
+    int64_t expected = COMPILE_NOT_STARTED;
+    if (!__atomic_compare_exchange_n(&function->recompileState, &expected, COMPILE_QUEUED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    if (nullptr != vm->compileQueue) {
+        vm->compileQueue->enqueue(function, -1, JIT_LEVEL_HOT);
+    } else {
+        compileFunctionSynchronously(vm, function, JIT_LEVEL_HOT);
+    }
+}
+
+/* compiles a function ahead of its counters, a hot request also claims the warm
+ * compile so the hot body is never replaced by a warm one */
+void precompileFunction(VM *vm, Function *function, int64_t level) {
+    if (JIT_LEVEL_HOT != level) {
+        compileFunction(vm, function);
+        return;
+    }
+    int64_t expected = COMPILE_NOT_STARTED;
+    if (!__atomic_compare_exchange_n(&function->compileState, &expected, COMPILE_QUEUED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    recompileFunction(vm, function);
+}
+
+/* OSR bodies are entered through bytecode 0, which can not also be a jump target */
+static bool jumpsToStart(Function *function) {
+    int64_t index = 0;
+    while (index < function->opcodeCount) {
+        Bytecodes opcode = (Bytecodes)function->opcodes[index];
+        if ((opcode >= Bytecodes::JMP) && (opcode <= Bytecodes::JMPG) && (0 == *(int64_t *)(function->opcodes + index + IMMEDIATE0))) {
+            return true;
+        }
+        index += Bytecode::getBytecodeLength(opcode);
+    }
+    return false;
+}
+
+void compileOSRFunction(VM *vm, Function *function, int64_t bytecodeIndex) {
+    int64_t expected = COMPILE_NOT_STARTED;
+    if ((0 != bytecodeIndex) && jumpsToStart(function)) {
+        __atomic_compare_exchange_n(&function->osrCompileState, &expected, COMPILE_FAILED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        return;
+    }
+    if (!__atomic_compare_exchange_n(&function->osrCompileState, &expected, COMPILE_QUEUED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    function->osrBytecodeIndex = bytecodeIndex;
+    if (nullptr != vm->compileQueue) {
+        vm->compileQueue->enqueue(function, bytecodeIndex, JIT_LEVEL_HOT);
+    } else {
+        compileOSRFunctionSynchronously(vm, function, bytecodeIndex);
+    }
+}
+
+bool compileFunctionSynchronously(VM *vm, Function *function, int64_t level) {
     InterpreterTypeDictionary types;
-    CMInterpreterMethod method(&types, vm, function);
+    CMInterpreterMethod method(&types, vm, function, -1, level);
+    int64_t *state = (JIT_LEVEL_HOT == level) ? &function->recompileState : &function->compileState;
+    const char *levelName = (JIT_LEVEL_HOT == level) ? "hot" : "warm";
     void *entry = 0;
     if (vm->verbose) {
-        fprintf(stderr, "Attempting to compile %s\n", function->functionName);
+        fprintf(stderr, "Attempting to compile %s at the %s level\n", function->functionName, levelName);
     }
     int32_t rc = compileMethodBuilder(&method, &entry);
-    if (0 == rc) {
-        if (vm->verbose) {
-            fprintf(stderr, "Successfully compiled %s\n", function->functionName);
-        }
-        function->compiledFunction = (void *)entry;
+    if (0 != rc) {
+        __atomic_store_n(state, COMPILE_FAILED, __ATOMIC_RELEASE);
+        return false;
     }
+    if (vm->verbose) {
+        fprintf(stderr, "Successfully compiled %s at the %s level\n", function->functionName, levelName);
+    }
+    /* the entry point is published last so a caller that sees it sees finished code,
+     * replacing a warm body repoints every caller that goes through the cell.
+     * A hot body is also published on its own so callers compiled later can bind
+     * to it without reading compiledFunction and a level separately */
+    if (JIT_LEVEL_HOT == level) {
+        __atomic_store_n(&function->hotFunction, (void *)entry, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&function->compiledFunction, (void *)entry, __ATOMIC_RELEASE);
+    __atomic_store_n(state, COMPILE_SUCCEEDED, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool compileOSRFunctionSynchronously(VM *vm, Function *function, int64_t bytecodeIndex) {
+    InterpreterTypeDictionary types;
+    CMInterpreterMethod method(&types, vm, function, bytecodeIndex);
+    void *entry = 0;
+    if (vm->verbose) {
+        fprintf(stderr, "Attempting to compile %s for OSR at bytecode %" PRId64 "\n", function->functionName, bytecodeIndex);
+    }
+    int32_t rc = compileMethodBuilder(&method, &entry);
+    if (0 != rc) {
+        __atomic_store_n(&function->osrCompileState, COMPILE_FAILED, __ATOMIC_RELEASE);
+        return false;
+    }
+    if (vm->verbose) {
+        fprintf(stderr, "Successfully compiled %s for OSR at bytecode %" PRId64 "\n", function->functionName, bytecodeIndex);
+    }
+    __atomic_store_n(&function->osrFunction, (void *)entry, __ATOMIC_RELEASE);
+    __atomic_store_n(&function->osrCompileState, COMPILE_SUCCEEDED, __ATOMIC_RELEASE);
+    return true;
+}
+
+int64_t callInterpretedFunction(VM *vm, Function *function, int64_t *args) {
+    if (function->invokedCount < function->compileThreshold) {
+        vm->tieringPolicy->countInvocation(vm, function);
+    }
+    CMInterpreterMethodType *compiled = (CMInterpreterMethodType *)__atomic_load_n(&function->compiledFunction, __ATOMIC_ACQUIRE);
+    if (nullptr != compiled) {
+        return compiled(vm, args);
+    }
+    IBInterpreterType *interpret = (IBInterpreterType *)vm->interpretFunction;
+    return interpret(vm, function, args);
+}
+
+/* generated interpreters count calls through the tiering policy like the C interpreter */
+void countFunctionInvocation(VM *vm, Function *function) {
+    vm->tieringPolicy->countInvocation(vm, function);
 }
 
 int64_t doNop(RuntimeBuilder *rb, IlBuilder *b)
@@ -116,7 +243,7 @@ int64_t doPushConstant(RuntimeBuilder *rb, IlBuilder *b)
 int64_t doPushArg(RuntimeBuilder *rb, IlBuilder *b) {
     IlValue *argIndex = rb->GetInt64Immediate(b, b->ConstInt64(1));
     IlValue *arg = getArg(rb, b, argIndex);
-    push(rb, b, arg);
+    push(rb, b, b->Copy(arg));
     rb->DefaultFallthrough(b, b->ConstInt64(9));
     return 0;
 }
@@ -124,7 +251,7 @@ int64_t doPushArg(RuntimeBuilder *rb, IlBuilder *b) {
 int64_t doPushLocal(RuntimeBuilder *rb, IlBuilder *b) {
     IlValue *localIndex = rb->GetInt64Immediate(b, b->ConstInt64(1));
     IlValue *local = getLocal(rb, b, localIndex);
-    push(rb, b, local);
+    push(rb, b, b->Copy(local));
     rb->DefaultFallthrough(b, b->ConstInt64(9));
     return 0;
 }
@@ -241,32 +368,20 @@ int64_t doCall(RuntimeBuilder *rb, IlBuilder *b) {
     b->     LoadIndirect("Function", "invokedCount",
     b->                 Load("newFunction")));
 
-    IlValue *incrementCondition = b->LessThan(
-                                  b->       Load("invokedCount"),
-                                  b->       ConstInt64(INVOCATIONS_BEFORE_COMPILE));
-
-    IlBuilder *incrementBuilder = nullptr;
-    b->IfThen(&incrementBuilder, incrementCondition);
-
-    incrementBuilder->Store("invokedCount",
-    incrementBuilder->     Add(
-    incrementBuilder->        Load("invokedCount"),
-    incrementBuilder->        ConstInt64(1)));
-
-    incrementBuilder->StoreIndirect("Function", "invokedCount",
-    incrementBuilder->              Load("newFunction"),
-    incrementBuilder->              Load("invokedCount"));
+    b->Store("compileThreshold",
+    b->     LoadIndirect("Function", "compileThreshold",
+    b->                 Load("newFunction")));
 
-    IlValue *compileCondition = incrementBuilder->EqualTo(
-                                incrementBuilder->       Load("invokedCount"),
-                                incrementBuilder->       ConstInt64(INVOCATIONS_BEFORE_COMPILE));
+    IlValue *countCondition = b->LessThan(
+                              b->       Load("invokedCount"),
+                              b->       Load("compileThreshold"));
 
-    IlBuilder *compileBuilder = nullptr;
-    incrementBuilder->IfThen(&compileBuilder, compileCondition);
+    IlBuilder *countBuilder = nullptr;
+    b->IfThen(&countBuilder, countCondition);
 
-    compileBuilder->Call("compileFunction", 2,
-    compileBuilder->    Load("vm"),
-    compileBuilder->    Load("newFunction"));
+    countBuilder->Call("countFunctionInvocation", 2,
+    countBuilder->    Load("vm"),
+    countBuilder->    Load("newFunction"));
 
     b->Store("compiledFunction",
     b->     LoadIndirect("Function", "compiledFunction",
@@ -324,7 +439,7 @@ int64_t doRet(RuntimeBuilder *rb, IlBuilder *b)
    b->                 Load("frameData"),
    b->                 NullAddress()));
 
-   freeFrame->Call("freeFrameData", 1, freeFrame->Load("frameData"));
+   freeFrame->StoreIndirect("VM", "stackTop", freeFrame->Load("vm"), freeFrame->Load("frameData"));
 
    b->Return(b->Load("return_retVal"));
    return 1;
@@ -57,7 +57,8 @@ IlValue *getLocal(RuntimeBuilder *rb, IlBuilder *builder, IlValue *localIndex);
 void setLocal(RuntimeBuilder *rb, IlBuilder *builder, IlValue *localIndex, IlValue *value);
 
 int64_t invokedCompiledFunction(VM *vm, Function *function, int64_t*args);
-void compileFunction(VM *vm, Function *function);
+int64_t callInterpretedFunction(VM *vm, Function *function, int64_t *args);
+void countFunctionInvocation(VM *vm, Function *function);
 
 int64_t doNop(RuntimeBuilder *rb, IlBuilder *b);
 int64_t doPushConstant(RuntimeBuilder *rb, IlBuilder *b);
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <inttypes.h>
+#include <chrono>
+
+#include "EL.hpp"
+#include "Helpers.hpp"
+#include "CompileQueue.hpp"
+
+CompileQueue::CompileQueue(VM *vm, int64_t threadCount)
+    : _vm(vm),
+    _shuttingDown(false),
+    _enqueuedCount(0),
+    _compiledCount(0),
+    _failedCount(0),
+    _discardedCount(0),
+    _maxQueueDepth(0),
+    _totalLatency(0),
+    _maxLatency(0),
+    _totalCompileTime(0),
+    _maxCompileTime(0)
+{
+    for (int64_t i = 0; i < threadCount; i++) {
+        _threads.push_back(std::thread(&CompileQueue::run, this));
+    }
+}
+
+CompileQueue::~CompileQueue() {
+    shutdown();
+}
+
+int64_t CompileQueue::currentMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CompileQueue::enqueue(Function *function, int64_t osrBytecodeIndex, int64_t level) {
+    CompileRequest request;
+    request.function = function;
+    request.osrBytecodeIndex = osrBytecodeIndex;
+    request.level = level;
+    request.enqueueTime = currentMicros();
+
+    std::lock_guard<std::mutex> guard(_queueLock);
+    if (_shuttingDown) {
+        return;
+    }
+    _requests.push_back(request);
+    _enqueuedCount += 1;
+    if ((int64_t)_requests.size() > _maxQueueDepth) {
+        _maxQueueDepth = _requests.size();
+    }
+    _queueNotEmpty.notify_one();
+}
+
+void CompileQueue::run() {
+    while (true) {
+        CompileRequest request;
+        {
+            std::unique_lock<std::mutex> guard(_queueLock);
+            _queueNotEmpty.wait(guard, [this] { return _shuttingDown || !_requests.empty(); });
+            if (_shuttingDown) {
+                return;
+            }
+            request = _requests.front();
+            _requests.pop_front();
+        }
+
+        bool compiled = false;
+        int64_t compileStart = 0;
+        int64_t compileEnd = 0;
+        {
+            std::lock_guard<std::mutex> compileGuard(_compileLock);
+            compileStart = currentMicros();
+            if (request.osrBytecodeIndex >= 0) {
+                compiled = compileOSRFunctionSynchronously(_vm, request.function, request.osrBytecodeIndex);
+            } else {
+                compiled = compileFunctionSynchronously(_vm, request.function, request.level);
+            }
+            compileEnd = currentMicros();
+        }
+
+        std::lock_guard<std::mutex> guard(_queueLock);
+        int64_t latency = compileEnd - request.enqueueTime;
+        int64_t compileTime = compileEnd - compileStart;
+        if (compiled) {
+            _compiledCount += 1;
+        } else {
+            _failedCount += 1;
+        }
+        _totalLatency += latency;
+        if (latency > _maxLatency) {
+            _maxLatency = latency;
+        }
+        _totalCompileTime += compileTime;
+        if (compileTime > _maxCompileTime) {
+            _maxCompileTime = compileTime;
+        }
+    }
+}
+
+void CompileQueue::shutdown() {
+    {
+        std::lock_guard<std::mutex> guard(_queueLock);
+        if (_shuttingDown) {
+            return;
+        }
+        /* requests still waiting are dropped, their functions just stay interpreted */
+        _shuttingDown = true;
+        _discardedCount += _requests.size();
+        _requests.clear();
+        _queueNotEmpty.notify_all();
+    }
+    for (size_t i = 0; i < _threads.size(); i++) {
+        _threads[i].join();
+    }
+    _threads.clear();
+}
+
+void CompileQueue::printStatistics(FILE *out) {
+    std::lock_guard<std::mutex> guard(_queueLock);
+    int64_t finished = _compiledCount + _failedCount;
+    fprintf(out, "JIT compile queue: %" PRId64 " requests, %" PRId64 " compiled, %" PRId64 " failed, %" PRId64 " discarded, max queue depth %" PRId64 "\n",
+            _enqueuedCount, _compiledCount, _failedCount, _discardedCount, _maxQueueDepth);
+    fprintf(out, "JIT compile latency: avg %" PRId64 "us max %" PRId64 "us, compile time: avg %" PRId64 "us max %" PRId64 "us\n",
+            finished ? _totalLatency / finished : 0, _maxLatency,
+            finished ? _totalCompileTime / finished : 0, _maxCompileTime);
+}
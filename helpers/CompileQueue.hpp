@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EL.hpp"
+
+#ifndef COMPILEQUEUE_INCL
+#define COMPILEQUEUE_INCL
+
+typedef struct CompileRequest {
+    Function *function;
+    int64_t osrBytecodeIndex; /* -1 for a normal method compile */
+    int64_t level; /* JIT_LEVEL_* */
+    int64_t enqueueTime;
+} CompileRequest;
+
+/* Hands hot functions to background threads so the interpreter never waits on
+ * the JIT. Compiled entries are published into Function::compiledFunction and
+ * Function::osrFunction by the worker once they are ready; until then callers
+ * keep interpreting.
+ */
+class CompileQueue {
+public:
+    CompileQueue(VM *vm, int64_t threadCount);
+    ~CompileQueue();
+
+    void enqueue(Function *function, int64_t osrBytecodeIndex, int64_t level);
+    void shutdown();
+    void printStatistics(FILE *out);
+
+private:
+    void run();
+    static int64_t currentMicros();
+
+    VM *_vm;
+    std::vector<std::thread> _threads;
+    std::deque<CompileRequest> _requests;
+    std::mutex _queueLock;
+    std::condition_variable _queueNotEmpty;
+    /* JitBuilder compilations share global state in OMR so only one runs at a time */
+    std::mutex _compileLock;
+    bool _shuttingDown;
+
+    int64_t _enqueuedCount;
+    int64_t _compiledCount;
+    int64_t _failedCount;
+    int64_t _discardedCount;
+    int64_t _maxQueueDepth;
+    int64_t _totalLatency;
+    int64_t _maxLatency;
+    int64_t _totalCompileTime;
+    int64_t _maxCompileTime;
+};
+
+#endif /* COMPILEQUEUE_INCL */
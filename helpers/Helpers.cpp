@@ -33,6 +33,7 @@
 #include <sys/time.h>
 
 #include "EL.hpp"
+#include "Bytecodes.hpp"
 
 void printString(int64_t ptr) {
 #define PRINTSTRING_LINE LINETOSTR(__LINE__)
@@ -48,7 +49,7 @@ void printStringHelper(int64_t ptr, int64_t length) {
 
 void printInt64(int64_t val) {
 #define PRINTINT64_LINE LINETOSTR(__LINE__)
-    fprintf(stdout, "%" PRIu64 "\n", val);
+    fprintf(stdout, "%" PRIu64, val);
 }
 int64_t getCurrentTime(int64_t val) {
 #define GETCURRENTTIME_LINE LINETOSTR(__LINE__)
@@ -58,15 +59,63 @@ int64_t getCurrentTime(int64_t val) {
     return time;
 }
 
-int64_t *allocateFrameData(Function *function, int64_t stackSize, int64_t localsSize) {
-    int64_t *data = (int64_t *)malloc(stackSize + localsSize);
-    if (nullptr == data) {
+int64_t *allocateFrameData(VM *vm, Function *function, int64_t stackSize, int64_t localsSize) {
+    int64_t *data = vm->stackTop;
+    int64_t *newStackTop = (int64_t *)((int8_t *)data + stackSize + localsSize);
+    if (newStackTop > vm->stackLimit) {
         fprintf(stderr, "Error creating stack and locals for function %s....exiting\n", function->functionName);
         exit(-1);
     }
+    vm->stackTop = newStackTop;
     return data;
 }
 
-void freeFrameData(int64_t *data) {
-    free(data);
+void freeFrameData(VM *vm, int64_t *data) {
+    vm->stackTop = data;
+}
+
+void allocateVMStack(VM *vm, int64_t slots) {
+    int64_t *stack = (int64_t *)malloc(slots * sizeof(int64_t));
+    if (nullptr == stack) {
+        fprintf(stderr, "Error allocating VM stack of %" PRIu64 " slots....exiting\n", slots);
+        exit(-1);
+    }
+    vm->stackBase = stack;
+    vm->stackTop = stack;
+    vm->stackLimit = stack + slots;
+}
+
+void freeVMStack(VM *vm) {
+    free(vm->stackBase);
+    vm->stackBase = nullptr;
+    vm->stackTop = nullptr;
+    vm->stackLimit = nullptr;
+}
+
+bool ensureFunctionLoaded(VM *vm, Function *function) {
+    if (nullptr != __atomic_load_n(&function->opcodes, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    if (nullptr == vm->loadFunction) {
+        return false;
+    }
+    return vm->loadFunction(vm->functionLoader, function);
+}
+
+/* a profile or jit cache can be older than the program, so an OSR loop it
+ * names has to be checked before asking for a body */
+bool isLoopHeader(Function *function, int64_t bytecodeIndex) {
+    int64_t index = 0;
+    while (index < function->opcodeCount) {
+        Bytecodes opcode = (Bytecodes)function->opcodes[index];
+        if ((opcode >= Bytecodes::JMP) && (opcode <= Bytecodes::JMPG)) {
+            int64_t target = 0;
+            memcpy(&target, function->opcodes + index + IMMEDIATE0, sizeof(target));
+            if ((bytecodeIndex == target) && (bytecodeIndex <= index)) {
+                return true;
+            }
+        }
+        index += Bytecode::getBytecodeLength(opcode);
+    }
+    return false;
 }
@@ -34,6 +34,16 @@ void printStringHelper(int64_t ptr, int64_t length);
 void printString(int64_t ptr);
 void printInt64(int64_t val);
 int64_t getCurrentTime(int64_t val);
-int64_t *allocateFrameData(Function *function, int64_t stackSize, int64_t localsSize);
-void freeFrameData(int64_t *data);
+int64_t *allocateFrameData(VM *vm, Function *function, int64_t stackSize, int64_t localsSize);
+void freeFrameData(VM *vm, int64_t *data);
+void allocateVMStack(VM *vm, int64_t slots);
+void freeVMStack(VM *vm);
+bool ensureFunctionLoaded(VM *vm, Function *function);
+bool isLoopHeader(Function *function, int64_t bytecodeIndex);
+void compileFunction(VM *vm, Function *function);
+void recompileFunction(VM *vm, Function *function);
+void precompileFunction(VM *vm, Function *function, int64_t level);
+void compileOSRFunction(VM *vm, Function *function, int64_t bytecodeIndex);
+bool compileFunctionSynchronously(VM *vm, Function *function, int64_t level);
+bool compileOSRFunctionSynchronously(VM *vm, Function *function, int64_t bytecodeIndex);
 
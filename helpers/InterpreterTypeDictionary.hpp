@@ -34,12 +34,20 @@ public:
         DefineField("Function", "functionName", PointerTo(Int8), offsetof(Function, functionName));
         DefineField("Function", "functionID", Int64, offsetof(Function, functionID));
         DefineField("Function", "invokedCount", Int64, offsetof(Function, invokedCount));
+        DefineField("Function", "compileThreshold", Int64, offsetof(Function, compileThreshold));
         DefineField("Function", "compiledFunction", Address, offsetof(Function, compiledFunction));
+        DefineField("Function", "osrFunction", Address, offsetof(Function, osrFunction));
+        DefineField("Function", "osrBytecodeIndex", Int64, offsetof(Function, osrBytecodeIndex));
+        DefineField("Function", "compileState", Int64, offsetof(Function, compileState));
+        DefineField("Function", "osrCompileState", Int64, offsetof(Function, osrCompileState));
+        DefineField("Function", "compiledInvokedCount", Int64, offsetof(Function, compiledInvokedCount));
+        DefineField("Function", "compiledBackEdgeCount", Int64, offsetof(Function, compiledBackEdgeCount));
         DefineField("Function", "maxStackDepth", Int64, offsetof(Function, maxStackDepth));
         DefineField("Function", "argCount", Int64, offsetof(Function, argCount));
         DefineField("Function", "localCount", Int64, offsetof(Function, localCount));
         DefineField("Function", "opcodeCount", Int64, offsetof(Function, opcodeCount));
         DefineField("Function", "opcodes", PointerTo(Int8), offsetof(Function, opcodes));
+        DefineField("Function", "threadedCode", Address, offsetof(Function, threadedCode));
         CloseStruct("Function");
 
         DefineStruct("String");
@@ -59,6 +67,9 @@ public:
         DefineField("VM", "functions", PointerTo(PointerTo(LookupStruct("Function"))), offsetof(VM, functions));
         DefineField("VM", "strings", PointerTo(PointerTo(LookupStruct("String"))), offsetof(VM, strings));
         DefineField("VM", "frame", PointerTo(LookupStruct("Frame")), offsetof(VM, frame));
+        DefineField("VM", "stackBase", PointerTo(Int64), offsetof(VM, stackBase));
+        DefineField("VM", "stackTop", PointerTo(Int64), offsetof(VM, stackTop));
+        DefineField("VM", "stackLimit", PointerTo(Int64), offsetof(VM, stackLimit));
         CloseStruct("VM");
     }
 };
@@ -24,6 +24,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <map>
 
@@ -39,28 +43,41 @@ using namespace std;
 #include "EL.hpp"
 #include "Bytecodes.hpp"
 
-ELParser::ELParser(const char * fileName) :
+ELParser::ELParser(const char * fileName, bool useMmap) :
     _fileName(fileName),
-    _program()
+    _useMmap(useMmap),
+    _data(NULL),
+    _size(0),
+    _cursor(0),
+    _mapped(false),
+    _program(),
+    _formatVersion(FORMAT_VERSION_0),
+    _formatFlags(0)
 {}
 
 ELParser::~ELParser() {
-    if (_program.programName != NULL) {
+    if ((_program.programName != NULL) && !isInImage(_program.programName)) {
         free(_program.programName);
         _program.programName = NULL;
     }
 
     Function **functions = _program.functions;
     if (functions != NULL) {
-        for (int i = 0; i < _program.functionCount; i++) {
+        for (int64_t i = 0; i < _program.functionCount; i++) {
             if (NULL != functions[i]) {
                 Function *function = functions[i];
-                if (NULL != function->functionName) {
+                if ((NULL != function->functionName) && !isInImage(function->functionName)) {
                     free(function->functionName);
                 }
-                if (NULL != function->opcodes) {
+                if ((NULL != function->opcodes) && !isInImage(function->opcodes)) {
                     free(function->opcodes);
                 }
+                if (NULL != function->threadedCode) {
+                    free(function->threadedCode);
+                }
+                if (NULL != function->registerCode) {
+                    free(function->registerCode);
+                }
                 free(function);
             }
         }
@@ -81,15 +98,71 @@ ELParser::~ELParser() {
         _program.strings = NULL;
     }
 
-    _infile.close();
+    if (NULL != _data) {
+        if (_mapped) {
+            munmap(_data, _size);
+        } else {
+            free(_data);
+        }
+        _data = NULL;
+    }
 }
 
 bool ELParser::initialize() {
-    _infile.open(_fileName, ios::binary | ios::in);
-    if (!_infile.good()) {
+    int fd = open(_fileName, O_RDONLY);
+    struct stat fileStat;
+    if ((-1 == fd) || (0 != fstat(fd, &fileStat))) {
         fprintf(stderr, "Error opening %s\n", _fileName);
+        if (-1 != fd) {
+            close(fd);
+        }
+        return false;
+    }
+    _size = fileStat.st_size;
+
+    if (_useMmap && (_size > 0)) {
+        void *mapping = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED != mapping) {
+            _data = (int8_t *)mapping;
+            _mapped = true;
+        }
+    }
+    if (NULL == _data) {
+        _data = (int8_t *)malloc(_size > 0 ? _size : 1);
+        int64_t bytesRead = 0;
+        while ((NULL != _data) && (bytesRead < _size)) {
+            ssize_t rc = read(fd, _data + bytesRead, _size - bytesRead);
+            if (rc <= 0) {
+                break;
+            }
+            bytesRead += rc;
+        }
+        if ((NULL == _data) || (bytesRead != _size)) {
+            fprintf(stderr, "Error reading %s\n", _fileName);
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+/* takes over an image that is already in memory, it has to come from malloc */
+bool ELParser::initialize(int8_t *image, int64_t size) {
+    _data = image;
+    _size = size;
+    _mapped = false;
+    return NULL != _data;
+}
+
+bool ELParser::readBytes(void *buf, int64_t length) {
+    if ((length < 0) || (_cursor + length > _size)) {
+        memset(buf, 0, length > 0 ? length : 0);
+        _cursor = _size;
         return false;
     }
+    memcpy(buf, _data + _cursor, length);
+    _cursor += length;
     return true;
 }
 
@@ -99,7 +172,23 @@ Program *ELParser::parseProgram() {
         return NULL;
     }
 
-    int programNameLength = parseNameLength();
+    if (0 != parseFormatVersion()) {
+        return NULL;
+    }
+
+    if (isNativeLayout()) {
+#if defined(EL_IS_BIG_ENDIAN)
+        bool bigEndianHost = true;
+#else
+        bool bigEndianHost = false;
+#endif
+        if (bigEndianHost != (0 != (_formatFlags & FORMAT_FLAG_BIG_ENDIAN))) {
+            fprintf(stderr, "EL program file was written in native layout for a host with the other byte order\n");
+            return NULL;
+        }
+    }
+
+    int64_t programNameLength = parseNameLength();
     char *programName = parseName(programNameLength);
     if (NULL == programName) {
         fprintf(stderr, "Malformed file. Can not parse program name\n");
@@ -107,12 +196,20 @@ Program *ELParser::parseProgram() {
     }
 
     _program.programName = programName;
+    _program.formatVersion = _formatVersion;
+    _program.functionLoader = this;
+    _program.loadFunction = &ELParser::loadFunctionCallback;
 
     // Parse functions
-    int functionCount = parseFunctionCount();
+    int64_t functionCount = parseFunctionCount();
+    /* every function takes more than a byte, anything bigger is a corrupt count */
+    if ((functionCount < 0) || (functionCount > _size)) {
+        fprintf(stderr, "Malformed file. Function count %" PRId64 " is out of range\n", functionCount);
+        return NULL;
+    }
     _program.functionCount = functionCount;
 
-    int functionsSize = sizeof(Function) * functionCount;
+    int64_t functionsSize = sizeof(Function *) * functionCount;
     Function **functions = (Function **)malloc(functionsSize);
     if (NULL == functions) {
         fprintf(stderr, "Error allocating function array\n");
@@ -121,13 +218,27 @@ Program *ELParser::parseProgram() {
     memset(functions, 0, functionsSize);
     _program.functions = functions;
 
-    for (int i = 0; i < functionCount; i++) {
-        Function *newFunc = parseFunction();
-        if (NULL == newFunc) {
-            fprintf(stderr, "Error parsing function %d\n", i);
+    if (hasFunctionDirectory()) {
+        /* bodies are verified on first use, see loadFunction */
+        if (0 != parseFunctionDirectory(functions, functionCount)) {
             return NULL;
         }
-        functions[newFunc->functionID] = newFunc;
+    } else {
+        for (int64_t i = 0; i < functionCount; i++) {
+            Function *newFunc = parseFunction();
+            if (NULL == newFunc) {
+                fprintf(stderr, "Error parsing function %" PRId64 "\n", i);
+                return NULL;
+            }
+            if ((newFunc->functionID < 0) || (newFunc->functionID >= functionCount) || (NULL != functions[newFunc->functionID])) {
+                fprintf(stderr, "Function %s has an invalid ID %" PRId64 "\n", newFunc->functionName, newFunc->functionID);
+                freeUnlessInImage(newFunc->opcodes);
+                freeUnlessInImage(newFunc->functionName);
+                free(newFunc);
+                return NULL;
+            }
+            functions[newFunc->functionID] = newFunc;
+        }
     }
 
     // Parse strings
@@ -145,6 +256,23 @@ Program *ELParser::parseProgram() {
     for (int i = 0; i < stringCount; i++) {
         int64_t stringID = parseInt64();
         int64_t stringLength = parseInt64();
+        if ((stringID < 0) || (stringID >= stringCount) || (stringLength < 0) || (_cursor + stringLength > _size)) {
+            fprintf(stderr, "Malformed string %d\n", i);
+            return NULL;
+        }
+        if (isNativeLayout()) {
+            /* the file image outlives the program so the data can stay where it is */
+            String *newString = (String *)malloc(sizeof(String));
+            if (NULL == newString) {
+                fprintf(stderr, "Error allocating String\n");
+                return NULL;
+            }
+            newString->length = stringLength;
+            newString->data = (char *)currentPosition();
+            _cursor += stringLength;
+            _program.strings[stringID] = newString;
+            continue;
+        }
         String *newString = (String *)malloc(sizeof(String) + stringLength);
         if (NULL == newString) {
             fprintf(stderr, "Error allocating String\n");
@@ -152,7 +280,7 @@ Program *ELParser::parseProgram() {
         }
         newString->length = stringLength;
         newString->data = (char*)((int8_t*)newString + sizeof(String));
-        _infile.read((char *)newString->data, stringLength);
+        readBytes(newString->data, stringLength);
 
         _program.strings[stringID] = newString;
     }
@@ -168,7 +296,7 @@ int ELParser::parseEyecatcher() {
     const char * eyecatcher = EYECATCHER;
     char buf[EYECATCHER_LENGTH];
 
-    _infile.read((char *)&buf, sizeof(buf));
+    readBytes(&buf, sizeof(buf));
     for (int i = 0; i < EYECATCHER_LENGTH; i++) {
         if (eyecatcher[i] != buf[i]) {
             return -1;
@@ -177,32 +305,65 @@ int ELParser::parseEyecatcher() {
     return 0;
 }
 
-int ELParser::parseNameLength() {
+int ELParser::parseFormatVersion() {
+    if ((_cursor >= _size) || (0 == (*currentPosition() & FORMAT_VERSION_MARKER))) {
+        _formatVersion = FORMAT_VERSION_0;
+        return 0;
+    }
+    int8_t buf[2];
+    readBytes(&buf, sizeof(buf));
+    _formatVersion = (uint8_t)buf[0] & ~FORMAT_VERSION_MARKER;
+    _formatFlags = buf[1];
+    if (_formatVersion > FORMAT_VERSION_CURRENT) {
+        fprintf(stderr, "Unsupported EL program file format version %" PRId64 "\n", _formatVersion);
+        return -1;
+    }
+    return 0;
+}
+
+int64_t ELParser::parseNameLength() {
+    if (_formatVersion >= FORMAT_VERSION_VARINT_COUNTS) {
+        return (int64_t)parseVarint();
+    }
     int8_t buf[1];
-    _infile.read((char *)&buf, sizeof(buf));
+    readBytes(&buf, sizeof(buf));
 
-    return (int)buf[0];
+    return (int64_t)buf[0];
 }
 
-char * ELParser::parseName(int nameLength) {
+char * ELParser::parseName(int64_t nameLength) {
+    if ((nameLength < 0) || (_cursor + nameLength > _size)) {
+        return NULL;
+    }
+    if (isNativeLayout()) {
+        char *name = (char *)currentPosition();
+        if ((_cursor + nameLength + 1 > _size) || ('\0' != name[nameLength])) {
+            return NULL;
+        }
+        _cursor += nameLength + 1;
+        return name;
+    }
     char *buf = (char *)malloc(sizeof(char) * (nameLength + 1));
     if (NULL == buf) {
         return NULL;
     }
-    _infile.read(buf, nameLength);
+    readBytes(buf, nameLength);
     buf[nameLength] = '\0';
     return buf;
 }
 
-int ELParser::parseFunctionCount() {
+int64_t ELParser::parseFunctionCount() {
+    if (_formatVersion >= FORMAT_VERSION_VARINT_COUNTS) {
+        return (int64_t)parseVarint();
+    }
     int8_t buf[1];
-    _infile.read((char *)&buf, sizeof(buf));
+    readBytes(&buf, sizeof(buf));
 
-    return (int)buf[0];
+    return (int64_t)buf[0];
 }
 
 Function * ELParser::parseFunction() {
-    int functionNameLength = parseNameLength();
+    int64_t functionNameLength = parseNameLength();
     char *functionName = parseName(functionNameLength);
 
     if (NULL == functionName) {
@@ -213,20 +374,138 @@ Function * ELParser::parseFunction() {
     int64_t functionID = parseFunctionSize();
     int64_t argCount = parseFunctionSize();
     int64_t opcodeCount = parseFunctionSize();
+    int64_t encodedSize = opcodeCount;
+    if (_formatVersion >= FORMAT_VERSION_COMPACT) {
+        encodedSize = parseFunctionSize();
+    }
     int64_t maxStackDepth = 0;
     int64_t localCount = 0;
+    if (isNativeLayout()) {
+        alignToNativeBody();
+    }
+    int64_t bodyStart = _cursor;
     int8_t *opcodes = parseFunctionOpcodes(opcodeCount, &maxStackDepth, &localCount);
 
     if (NULL == opcodes) {
-        free(functionName);
+        freeUnlessInImage(functionName);
+        return NULL;
+    }
+
+    if (encodedSize != _cursor - bodyStart) {
+        fprintf(stderr, "Function %s body is %" PRId64 " bytes but the header says %" PRId64 "\n", functionName, _cursor - bodyStart, encodedSize);
+        freeUnlessInImage(opcodes);
+        freeUnlessInImage(functionName);
         return NULL;
     }
 
+    Function *function = newFunction(functionName, functionID, argCount, opcodeCount, maxStackDepth, localCount, opcodes);
+    if (NULL == function) {
+        freeUnlessInImage(opcodes);
+        freeUnlessInImage(functionName);
+        return NULL;
+    }
+    return function;
+}
+
+int ELParser::parseFunctionDirectory(Function **functions, int64_t functionCount) {
+    _directory.resize(functionCount);
+    for (int64_t i = 0; i < functionCount; i++) {
+        int64_t functionNameLength = parseNameLength();
+        char *functionName = parseName(functionNameLength);
+        if (NULL == functionName) {
+            fprintf(stderr, "error parsing function name in directory entry %" PRId64 "\n", i);
+            return -1;
+        }
+
+        int64_t functionID = parseInt64();
+        int64_t argCount = parseInt64();
+        int64_t opcodeCount = parseInt64();
+        int64_t encodedSize = parseInt64();
+        int64_t maxStackDepth = parseInt64();
+        int64_t localCount = parseInt64();
+        int64_t bodyOffset = parseInt64();
+        if ((functionID < 0) || (functionID >= functionCount) || (NULL != functions[functionID])
+            || (opcodeCount < 0) || (encodedSize < 0) || (maxStackDepth < 0) || (localCount < 0)
+            || (bodyOffset < _cursor) || (bodyOffset + encodedSize > _size)
+            || (isNativeLayout() && (0 != (bodyOffset % FORMAT_NATIVE_BODY_ALIGNMENT)))) {
+            fprintf(stderr, "Malformed directory entry %" PRId64 " for function %s\n", i, functionName);
+            freeUnlessInImage(functionName);
+            return -1;
+        }
+
+        Function *function = newFunction(functionName, functionID, argCount, opcodeCount, maxStackDepth, localCount, nullptr);
+        if (NULL == function) {
+            freeUnlessInImage(functionName);
+            return -1;
+        }
+        functions[functionID] = function;
+        _directory[functionID].bodyOffset = bodyOffset;
+        _directory[functionID].encodedSize = encodedSize;
+    }
+
+    int64_t stringTableOffset = parseInt64();
+    if ((stringTableOffset < _cursor) || (stringTableOffset > _size)) {
+        fprintf(stderr, "Malformed function directory, string table offset %" PRId64 " is out of range\n", stringTableOffset);
+        return -1;
+    }
+    _cursor = stringTableOffset;
+    return 0;
+}
+
+bool ELParser::loadFunctionCallback(void *parser, Function *function) {
+    return ((ELParser *)parser)->loadFunction(function);
+}
+
+bool ELParser::loadFunction(Function *function) {
+    std::lock_guard<std::mutex> guard(_loadLock);
+    if (NULL != function->opcodes) {
+        return true;
+    }
+    if ((function->functionID < 0) || (function->functionID >= (int64_t)_directory.size())) {
+        return false;
+    }
+
+    FunctionDirectoryEntry *entry = &_directory[function->functionID];
+    _cursor = entry->bodyOffset;
+    int64_t maxStackDepth = 0;
+    int64_t localCount = 0;
+    int8_t *opcodes = parseFunctionOpcodes(function->opcodeCount, &maxStackDepth, &localCount);
+    if (NULL == opcodes) {
+        fprintf(stderr, "Error loading function %s\n", function->functionName);
+        return false;
+    }
+
+    if (entry->encodedSize != _cursor - entry->bodyOffset) {
+        fprintf(stderr, "Function %s body is %" PRId64 " bytes but the directory says %" PRId64 "\n", function->functionName, _cursor - entry->bodyOffset, entry->encodedSize);
+        freeUnlessInImage(opcodes);
+        return false;
+    }
+
+    /* frames were sized from the directory before the body was seen, so it has to be exact */
+    if ((maxStackDepth != function->maxStackDepth) || (localCount != function->localCount)) {
+        fprintf(stderr, "Function %s needs stack depth %" PRId64 " and %" PRId64 " locals but the directory says %" PRId64 " and %" PRId64 "\n",
+                function->functionName, maxStackDepth, localCount, function->maxStackDepth, function->localCount);
+        freeUnlessInImage(opcodes);
+        return false;
+    }
+
+    __atomic_store_n(&function->opcodes, opcodes, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool ELParser::loadAllFunctions() {
+    for (int64_t i = 0; i < _program.functionCount; i++) {
+        if ((NULL != _program.functions[i]) && !loadFunction(_program.functions[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Function * ELParser::newFunction(char *functionName, int64_t functionID, int64_t argCount, int64_t opcodeCount, int64_t maxStackDepth, int64_t localCount, int8_t *opcodes) {
     Function *function = (Function *)malloc(sizeof(Function));
     if (NULL == function) {
         fprintf(stderr, "error allocating function\n");
-        free(opcodes);
-        free(functionName);
         return NULL;
     }
 
@@ -237,15 +516,29 @@ Function * ELParser::parseFunction() {
     function->localCount = localCount;
     function->opcodeCount = opcodeCount;
     function->opcodes = opcodes;
+    function->threadedCode = nullptr;
+    function->registerCode = nullptr;
     function->compiledFunction = nullptr;
+    function->osrFunction = nullptr;
+    function->osrBytecodeIndex = -1;
+    function->compileState = COMPILE_NOT_STARTED;
+    function->osrCompileState = COMPILE_NOT_STARTED;
+    function->recompileState = COMPILE_NOT_STARTED;
+    function->hotFunction = nullptr;
+    function->compiledInvokedCount = 0;
+    function->compiledBackEdgeCount = 0;
+    function->baselineState = COMPILE_NOT_STARTED;
     function->invokedCount = 0;
+    function->baselineThreshold = INVOCATIONS_BEFORE_BASELINE;
+    function->compileThreshold = INVOCATIONS_BEFORE_COMPILE;
+    function->osrThreshold = BACKEDGES_BEFORE_OSR;
 
     return function;
 }
 
 int64_t ELParser::parseFunctionSize() {
     int64_t val;
-    _infile.read((char *)&val, sizeof(int64_t));
+    readBytes(&val, sizeof(int64_t));
     convertToPlatformEndian(val);
 
     return val;
@@ -253,15 +546,81 @@ int64_t ELParser::parseFunctionSize() {
 
 int64_t ELParser::parseInt64() {
     int64_t val;
-    _infile.read((char *)&val, sizeof(int64_t));
+    readBytes(&val, sizeof(int64_t));
     convertToPlatformEndian(val);
 
     return val;
 }
 
+uint64_t ELParser::parseVarint() {
+    uint64_t val = 0;
+    int32_t shift = 0;
+    uint8_t byte = 0;
+    do {
+        if (!readBytes(&byte, 1) || (shift > 63)) {
+            return 0;
+        }
+        val |= ((uint64_t)(byte & 0x7F)) << shift;
+        shift += 7;
+    } while (0 != (byte & 0x80));
+    return val;
+}
+
+int64_t ELParser::parseOperand() {
+    if (isNativeLayout()) {
+        int64_t val;
+        readBytes(&val, sizeof(int64_t));
+        return val;
+    }
+    if (_formatVersion >= FORMAT_VERSION_COMPACT) {
+        return (int64_t)parseVarint();
+    }
+    return parseInt64();
+}
+
+int64_t ELParser::parseSignedOperand() {
+    if (isNativeLayout()) {
+        return parseOperand();
+    }
+    if (_formatVersion >= FORMAT_VERSION_COMPACT) {
+        uint64_t val = parseVarint();
+        return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+    }
+    return parseInt64();
+}
+
+static int64_t immediateBytes(Bytecodes opcode) {
+    switch(opcode) {
+    case Bytecodes::PUSH_CONSTANT:
+    case Bytecodes::PUSH_ARG:
+    case Bytecodes::PUSH_LOCAL:
+    case Bytecodes::POP_LOCAL:
+    case Bytecodes::JMP:
+    case Bytecodes::JMPE:
+    case Bytecodes::JMPL:
+    case Bytecodes::JMPG:
+    case Bytecodes::PRINT_STRING:
+        return 8;
+    case Bytecodes::CALL:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
 int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMaxStackDepth, int64_t *localCount) {
     int64_t opcodeSize = opcodeCount * sizeof(int8_t);
-    int8_t * opcodes = (int8_t *)malloc(opcodeSize);
+    int8_t * opcodes = NULL;
+    if (isNativeLayout()) {
+        /* already in the loaded layout, verify it in place */
+        if ((opcodeCount < 0) || (_cursor + opcodeSize > _size)) {
+            fprintf(stderr, "Function body runs past the end of the file\n");
+            return NULL;
+        }
+        opcodes = currentPosition();
+    } else {
+        opcodes = (int8_t *)malloc(opcodeSize);
+    }
     if (NULL == opcodes) {
         return NULL;
     }
@@ -278,7 +637,7 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
             if (currentStackDepth != it->second) {
                 if (currentStackDepth != -1) {
                     fprintf(stderr, "Mismatched stack size for instruction %" PRIu64 " that was a forward jump destination %" PRIu64 " != %" PRIu64 "\n", index, currentStackDepth, it->second);
-                    free(opcodes);
+                    freeUnlessInImage(opcodes);
                     return NULL;
                 }
             }
@@ -286,14 +645,29 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
         } else {
             if (currentStackDepth == -1) {
                 fprintf(stderr, "Unreachable instruction after a return at index %" PRIu64 "\n", index);
-                free(opcodes);
+                freeUnlessInImage(opcodes);
                 return NULL;
             }
             destinationStackSizes.insert(make_pair(index, currentStackDepth));
         }
 
-        _infile.read((char *)&opcodes[index], 1);
-        Bytecodes opcode = (Bytecodes)opcodes[index++];
+        int8_t opcodeByte = 0;
+        if (!readBytes(&opcodeByte, 1)) {
+            fprintf(stderr, "Unexpected end of file at index %" PRIu64 "\n", index);
+            freeUnlessInImage(opcodes);
+            return NULL;
+        }
+        if (!isNativeLayout()) {
+            opcodes[index] = opcodeByte;
+        }
+        Bytecodes opcode = (Bytecodes)opcodeByte;
+        index += 1;
+
+        if (index + immediateBytes(opcode) > opcodeCount) {
+            fprintf(stderr, "Immediates of instruction at index %" PRIu64 " run past the end of the function body\n", index - 1);
+            freeUnlessInImage(opcodes);
+            return NULL;
+        }
 
         switch(opcode) {
         case Bytecodes::NOP:
@@ -302,9 +676,7 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
         }
         case Bytecodes::PUSH_CONSTANT:
         {
-            int64_t val;
-            _infile.read((char *)&val, sizeof(int64_t));
-            convertToPlatformEndian(val);
+            int64_t val = parseSignedOperand();
             write64(&opcodes[index], val);
             index += 8;
             currentStackDepth += 1;
@@ -312,9 +684,7 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
         }
         case Bytecodes::PUSH_ARG:
         {
-            int64_t val;
-            _infile.read((char *)&val, sizeof(int64_t));
-            convertToPlatformEndian(val);
+            int64_t val = parseOperand();
             write64(&opcodes[index], val);
             index += 8;
             currentStackDepth += 1;
@@ -322,9 +692,7 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
         }
         case Bytecodes::PUSH_LOCAL:
         {
-            int64_t val;
-            _infile.read((char *)&val, sizeof(int64_t));
-            convertToPlatformEndian(val);
+            int64_t val = parseOperand();
             if (val > maxLocalID) {
                 maxLocalID = val;
             }
@@ -338,9 +706,7 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
             break;
         case Bytecodes::POP_LOCAL:
         {
-            int64_t val;
-            _infile.read((char *)&val, sizeof(int64_t));
-            convertToPlatformEndian(val);
+            int64_t val = parseOperand();
             if (val > maxLocalID) {
                 maxLocalID = val;
             }
@@ -369,9 +735,10 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
             break;
         case Bytecodes::JMP:
         {
-            int64_t destination;
-            _infile.read((char *)&destination, sizeof(int64_t));
-            convertToPlatformEndian(destination);
+            int64_t destination = parseSignedOperand();
+            if ((_formatVersion >= FORMAT_VERSION_COMPACT) && !isNativeLayout()) {
+                destination += index - 1;
+            }
             write64(&opcodes[index], destination);
             index += 8;
 
@@ -380,7 +747,7 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
              if (!ret.second) {
                  if (currentStackDepth != ret.first->second) {
                      fprintf(stderr, "Stack size mismatch (%" PRIu64 " != %" PRIu64 ") jumping to instruction %" PRIu64 "\n", currentStackDepth, ret.first->second, destination);
-                     free(opcodes);
+                     freeUnlessInImage(opcodes);
                      return NULL;
                  }
              }
@@ -391,9 +758,10 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
         case Bytecodes::JMPL:
         case Bytecodes::JMPG:
         {
-            int64_t destination;
-            _infile.read((char *)&destination, sizeof(int64_t));
-            convertToPlatformEndian(destination);
+            int64_t destination = parseSignedOperand();
+            if ((_formatVersion >= FORMAT_VERSION_COMPACT) && !isNativeLayout()) {
+                destination += index - 1;
+            }
             write64(&opcodes[index], destination);
             index += 8;
 
@@ -403,7 +771,7 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
             if (!ret.second) {
                 if (currentStackDepth != ret.first->second) {
                     fprintf(stderr, "Stack size mismatch (%" PRIu64 " != %" PRIu64 ") jumping to instruction %" PRIu64 "\n", currentStackDepth, ret.first->second, destination);
-                    free(opcodes);
+                    freeUnlessInImage(opcodes);
                     return NULL;
                 }
             }
@@ -411,14 +779,11 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
         }
         case Bytecodes::CALL:
         {
-            int64_t val;
-            _infile.read((char *)&val, sizeof(int64_t));
-            convertToPlatformEndian(val);
+            int64_t val = parseOperand();
             write64(&opcodes[index], val);
             index += 8;
 
-            _infile.read((char *)&val, sizeof(int64_t));
-            convertToPlatformEndian(val);
+            val = parseOperand();
             write64(&opcodes[index], val);
             index += 8;
 
@@ -428,16 +793,14 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
         case Bytecodes::RET:
             if (currentStackDepth != 1) {
                 fprintf(stderr, "Stack size %" PRIu64 " != 1 on return\n", currentStackDepth);
-                free(opcodes);
+                freeUnlessInImage(opcodes);
                 return NULL;
             }
             currentStackDepth = -1;
             break;
         case Bytecodes::PRINT_STRING:
         {
-            int64_t val;
-            _infile.read((char *)&val, sizeof(int64_t));
-            convertToPlatformEndian(val);
+            int64_t val = parseOperand();
             write64(&opcodes[index], val);
             index += 8;
             break;
@@ -459,7 +822,7 @@ int8_t *ELParser::parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMax
         }
         default:
             fprintf(stderr, "Unknown opcode at index %" PRIu64 " during load\n", index);
-            free(opcodes);
+            freeUnlessInImage(opcodes);
             return NULL;
         }
         if (currentStackDepth > maxStackDepth) {
@@ -476,5 +839,8 @@ inline int64_t ELParser::read64(int8_t *opcodes) {
 }
 
 inline void ELParser::write64(int8_t *opcodes, int64_t val) {
-   *((int64_t *)opcodes) = val;
+   /* native layout bodies are verified in place and are already correct */
+   if (!isNativeLayout()) {
+       *((int64_t *)opcodes) = val;
+   }
 }
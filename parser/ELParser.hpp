@@ -27,10 +27,12 @@
 #include <stdarg.h>
 #include <cstring>
 #include <cstddef>
-#include <iostream>
-#include <fstream>
+
+#include <mutex>
+#include <vector>
 
 #include "EL.hpp"
+#include "Bytecodes.hpp"
 
 #ifndef ELPARSER_INCL
 #define ELPARSER_INCL
@@ -52,26 +54,67 @@
 #endif
 #endif
 
+/* where a lazily loaded function body lives in the file image */
+typedef struct FunctionDirectoryEntry {
+    int64_t bodyOffset;
+    int64_t encodedSize;
+} FunctionDirectoryEntry;
+
 class ELParser {
 public:
-    ELParser(const char *fileName);
+    ELParser(const char *fileName, bool useMmap = true);
     ~ELParser();
 
     bool initialize();
+    bool initialize(int8_t *image, int64_t size);
     Program *parseProgram();
+    bool loadFunction(Function *function);
+    bool loadAllFunctions();
+    /* the program file as loaded, the JIT cache is keyed on it */
+    const int8_t *image() { return _data; }
+    int64_t imageSize() { return _size; }
 
 private:
     const char *_fileName;
-    std::ifstream _infile;
+    bool _useMmap;
+    /* the whole file image, either mapped or read into a heap buffer */
+    int8_t *_data;
+    int64_t _size;
+    int64_t _cursor;
+    bool _mapped;
     Program _program;
+    int64_t _formatVersion;
+    int8_t _formatFlags;
+    /* indexed by function ID, only filled in for files with a function directory */
+    std::vector<FunctionDirectoryEntry> _directory;
+    std::mutex _loadLock;
+
+    bool readBytes(void *buf, int64_t length);
+    int8_t *currentPosition() { return _data + _cursor; }
+    bool isInImage(void *ptr) { return ((int8_t *)ptr >= _data) && ((int8_t *)ptr < _data + _size); }
+    void freeUnlessInImage(void *ptr) {
+        if (!isInImage(ptr)) {
+            free(ptr);
+        }
+    }
+    bool isNativeLayout() { return (_formatVersion >= FORMAT_VERSION_COMPACT) && (0 != (_formatFlags & FORMAT_FLAG_NATIVE)); }
+    bool hasFunctionDirectory() { return (_formatVersion >= FORMAT_VERSION_COMPACT) && (0 != (_formatFlags & FORMAT_FLAG_FUNCTION_DIRECTORY)); }
+    void alignToNativeBody() { _cursor = (_cursor + FORMAT_NATIVE_BODY_ALIGNMENT - 1) & ~(int64_t)(FORMAT_NATIVE_BODY_ALIGNMENT - 1); }
+    static bool loadFunctionCallback(void *parser, Function *function);
 
     int parseEyecatcher();
-    int parseNameLength();
-    char * parseName(int nameLength);
-    int parseFunctionCount();
+    int parseFormatVersion();
+    int64_t parseNameLength();
+    char * parseName(int64_t nameLength);
+    int64_t parseFunctionCount();
     Function * parseFunction();
+    int parseFunctionDirectory(Function **functions, int64_t functionCount);
+    Function * newFunction(char *functionName, int64_t functionID, int64_t argCount, int64_t opcodeCount, int64_t maxStackDepth, int64_t localCount, int8_t *opcodes);
     int64_t parseFunctionSize();
     int64_t parseInt64();
+    uint64_t parseVarint();
+    int64_t parseOperand();
+    int64_t parseSignedOperand();
     int8_t * parseFunctionOpcodes(int64_t opcodeCount, int64_t *functionMaxStackSize, int64_t *localCount);
     int64_t read64(int8_t *bytes);
     void write64(int8_t *opcodes, int64_t val);
@@ -0,0 +1,449 @@
+/*******************************************************************************
+ * Copyright (c) 2016, 2018 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cstring>
+#include <cstddef>
+
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "EL.hpp"
+
+#include "Bytecodes.hpp"
+#include "Helpers.hpp"
+#include "BaselineCompiler.hpp"
+#include "TieringPolicy.hpp"
+#include "CMInterpreterMethod.hpp"
+
+typedef int64_t (BaselineInterpretType)(VM *vm, Function *function, int64_t *args);
+
+static void baselineStackOverflow(Function *function) {
+    fprintf(stderr, "VM stack overflow calling function %s....exiting\n", function->functionName);
+    exit(-1);
+}
+
+static void baselinePrintString(String *string) {
+    fprintf(stdout, "%.*s", (int32_t)string->length, string->data);
+}
+
+static void baselinePrintInt64(int64_t value) {
+    fprintf(stdout, "%" PRIu64, value);
+}
+
+static int64_t baselineCurrentTime() {
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((int64_t)tp.tv_sec) * 1000 + tp.tv_usec / 1000;
+}
+
+static void baselineHalt() {
+    exit(0);
+}
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define BASELINE_SUPPORTED 1
+
+/* Generated code keeps the VM in r14, args in r13, locals in rbx and the next
+ * free operand stack slot in r12. All four are callee saved in the System V
+ * ABI so helpers can be called without spilling anything. Operand stack values
+ * live in memory, which keeps every template independent of its neighbours.
+ */
+static const uint8_t prologueCode[] = {
+    0x55,                                     /* push rbp */
+    0x48, 0x89, 0xE5,                         /* mov rbp, rsp */
+    0x53,                                     /* push rbx */
+    0x41, 0x54,                               /* push r12 */
+    0x41, 0x55,                               /* push r13 */
+    0x41, 0x56,                               /* push r14 */
+    0x49, 0x89, 0xFE,                         /* mov r14, rdi */
+    0x49, 0x89, 0xF5,                         /* mov r13, rsi */
+    0x48, 0x8B, 0x9F, 0, 0, 0, 0,             /* mov rbx, [rdi + stackTop] */
+    0x4C, 0x8D, 0xA3, 0, 0, 0, 0,             /* lea r12, [rbx + locals] */
+    0x48, 0x8D, 0x83, 0, 0, 0, 0,             /* lea rax, [rbx + frame] */
+    0x49, 0x3B, 0x86, 0, 0, 0, 0,             /* cmp rax, [r14 + stackLimit] */
+    0x76, 0x16,                               /* jbe past the overflow call */
+    0x48, 0xBF, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rdi, function */
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rax, baselineStackOverflow */
+    0xFF, 0xD0,                               /* call rax */
+    0x49, 0x89, 0x86, 0, 0, 0, 0              /* mov [r14 + stackTop], rax */
+};
+
+static const uint8_t pushConstantCode[] = {
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rax, constant */
+    0x49, 0x89, 0x04, 0x24,                   /* mov [r12], rax */
+    0x49, 0x83, 0xC4, 0x08                    /* add r12, 8 */
+};
+
+static const uint8_t pushArgCode[] = {
+    0x49, 0x8B, 0x85, 0, 0, 0, 0,             /* mov rax, [r13 + slot] */
+    0x49, 0x89, 0x04, 0x24,                   /* mov [r12], rax */
+    0x49, 0x83, 0xC4, 0x08                    /* add r12, 8 */
+};
+
+static const uint8_t pushLocalCode[] = {
+    0x48, 0x8B, 0x83, 0, 0, 0, 0,             /* mov rax, [rbx + slot] */
+    0x49, 0x89, 0x04, 0x24,                   /* mov [r12], rax */
+    0x49, 0x83, 0xC4, 0x08                    /* add r12, 8 */
+};
+
+static const uint8_t popCode[] = {
+    0x49, 0x83, 0xEC, 0x08                    /* sub r12, 8 */
+};
+
+static const uint8_t popLocalCode[] = {
+    0x49, 0x83, 0xEC, 0x08,                   /* sub r12, 8 */
+    0x49, 0x8B, 0x04, 0x24,                   /* mov rax, [r12] */
+    0x48, 0x89, 0x83, 0, 0, 0, 0              /* mov [rbx + slot], rax */
+};
+
+static const uint8_t dupCode[] = {
+    0x49, 0x8B, 0x44, 0x24, 0xF8,             /* mov rax, [r12 - 8] */
+    0x49, 0x89, 0x04, 0x24,                   /* mov [r12], rax */
+    0x49, 0x83, 0xC4, 0x08                    /* add r12, 8 */
+};
+
+static const uint8_t addCode[] = {
+    0x49, 0x83, 0xEC, 0x08,                   /* sub r12, 8 */
+    0x49, 0x8B, 0x04, 0x24,                   /* mov rax, [r12] */
+    0x49, 0x01, 0x44, 0x24, 0xF8              /* add [r12 - 8], rax */
+};
+
+static const uint8_t subCode[] = {
+    0x49, 0x83, 0xEC, 0x08,                   /* sub r12, 8 */
+    0x49, 0x8B, 0x04, 0x24,                   /* mov rax, [r12] */
+    0x49, 0x29, 0x44, 0x24, 0xF8              /* sub [r12 - 8], rax */
+};
+
+static const uint8_t mulCode[] = {
+    0x49, 0x83, 0xEC, 0x08,                   /* sub r12, 8 */
+    0x49, 0x8B, 0x04, 0x24,                   /* mov rax, [r12] */
+    0x49, 0x0F, 0xAF, 0x44, 0x24, 0xF8,       /* imul rax, [r12 - 8] */
+    0x49, 0x89, 0x44, 0x24, 0xF8              /* mov [r12 - 8], rax */
+};
+
+static const uint8_t divCode[] = {
+    0x49, 0x83, 0xEC, 0x08,                   /* sub r12, 8 */
+    0x49, 0x8B, 0x0C, 0x24,                   /* mov rcx, [r12] */
+    0x49, 0x8B, 0x44, 0x24, 0xF8,             /* mov rax, [r12 - 8] */
+    0x48, 0x99,                               /* cqo */
+    0x48, 0xF7, 0xF9,                         /* idiv rcx */
+    0x49, 0x89, 0x44, 0x24, 0xF8              /* mov [r12 - 8], rax */
+};
+
+static const uint8_t modCode[] = {
+    0x49, 0x83, 0xEC, 0x08,                   /* sub r12, 8 */
+    0x49, 0x8B, 0x0C, 0x24,                   /* mov rcx, [r12] */
+    0x49, 0x8B, 0x44, 0x24, 0xF8,             /* mov rax, [r12 - 8] */
+    0x48, 0x99,                               /* cqo */
+    0x48, 0xF7, 0xF9,                         /* idiv rcx */
+    0x49, 0x89, 0x54, 0x24, 0xF8              /* mov [r12 - 8], rdx */
+};
+
+static const uint8_t jmpCode[] = {
+    0xE9, 0, 0, 0, 0                          /* jmp target */
+};
+
+#define COMPARE_AND_JUMP_CODE(condition) \
+    0x49, 0x83, 0xEC, 0x10,                   /* sub r12, 16 */ \
+    0x49, 0x8B, 0x04, 0x24,                   /* mov rax, [r12] */ \
+    0x49, 0x3B, 0x44, 0x24, 0x08,             /* cmp rax, [r12 + 8] */ \
+    0x0F, condition, 0, 0, 0, 0               /* jcc target */
+
+static const uint8_t jmpeCode[] = { COMPARE_AND_JUMP_CODE(0x84) };
+static const uint8_t jmplCode[] = { COMPARE_AND_JUMP_CODE(0x8C) };
+static const uint8_t jmpgCode[] = { COMPARE_AND_JUMP_CODE(0x8F) };
+
+static const uint8_t callCode[] = {
+    0x4C, 0x89, 0xF7,                         /* mov rdi, r14 */
+    0x48, 0xBE, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rsi, callee */
+    0x49, 0x8D, 0x94, 0x24, 0, 0, 0, 0,       /* lea rdx, [r12 - args] */
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rax, baselineCall */
+    0xFF, 0xD0,                               /* call rax */
+    0x4D, 0x8D, 0xA4, 0x24, 0, 0, 0, 0,       /* lea r12, [r12 - args] */
+    0x49, 0x89, 0x04, 0x24,                   /* mov [r12], rax */
+    0x49, 0x83, 0xC4, 0x08                    /* add r12, 8 */
+};
+
+static const uint8_t retCode[] = {
+    0x49, 0x83, 0xEC, 0x08,                   /* sub r12, 8 */
+    0x49, 0x8B, 0x04, 0x24,                   /* mov rax, [r12] */
+    0x49, 0x89, 0x9E, 0, 0, 0, 0,             /* mov [r14 + stackTop], rbx */
+    0x41, 0x5E,                               /* pop r14 */
+    0x41, 0x5D,                               /* pop r13 */
+    0x41, 0x5C,                               /* pop r12 */
+    0x5B,                                     /* pop rbx */
+    0x5D,                                     /* pop rbp */
+    0xC3                                      /* ret */
+};
+
+static const uint8_t printStringCode[] = {
+    0x48, 0xBF, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rdi, string */
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rax, baselinePrintString */
+    0xFF, 0xD0                                /* call rax */
+};
+
+static const uint8_t printInt64Code[] = {
+    0x49, 0x83, 0xEC, 0x08,                   /* sub r12, 8 */
+    0x49, 0x8B, 0x3C, 0x24,                   /* mov rdi, [r12] */
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rax, baselinePrintInt64 */
+    0xFF, 0xD0                                /* call rax */
+};
+
+static const uint8_t currentTimeCode[] = {
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rax, baselineCurrentTime */
+    0xFF, 0xD0,                               /* call rax */
+    0x49, 0x89, 0x04, 0x24,                   /* mov [r12], rax */
+    0x49, 0x83, 0xC4, 0x08                    /* add r12, 8 */
+};
+
+static const uint8_t haltCode[] = {
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0,       /* mov rax, baselineHalt */
+    0xFF, 0xD0                                /* call rax */
+};
+
+#define TEMPLATE(code) code, (int32_t)sizeof(code)
+
+static const BaselineTemplate prologueTemplate = {
+    TEMPLATE(prologueCode), (void *)&baselineStackOverflow, 7, {
+        { 20, PATCH_STACK_TOP32 }, { 27, PATCH_LOCALS32 }, { 34, PATCH_FRAME32 }, { 41, PATCH_STACK_LIMIT32 },
+        { 49, PATCH_FUNCTION64 }, { 59, PATCH_HELPER64 }, { 72, PATCH_STACK_TOP32 } } };
+
+/* indexed by Bytecodes */
+static const BaselineTemplate bytecodeTemplates[] = {
+    { nullptr, 0, nullptr, 0, {} },                                                          /* NOP */
+    { TEMPLATE(pushConstantCode), nullptr, 1, { { 2, PATCH_OPERAND64 } } },
+    { TEMPLATE(pushArgCode), nullptr, 1, { { 3, PATCH_SLOT32 } } },
+    { TEMPLATE(pushLocalCode), nullptr, 1, { { 3, PATCH_SLOT32 } } },
+    { TEMPLATE(popCode), nullptr, 0, {} },
+    { TEMPLATE(popLocalCode), nullptr, 1, { { 11, PATCH_SLOT32 } } },
+    { TEMPLATE(dupCode), nullptr, 0, {} },
+    { TEMPLATE(addCode), nullptr, 0, {} },
+    { TEMPLATE(subCode), nullptr, 0, {} },
+    { TEMPLATE(mulCode), nullptr, 0, {} },
+    { TEMPLATE(divCode), nullptr, 0, {} },
+    { TEMPLATE(modCode), nullptr, 0, {} },
+    { TEMPLATE(jmpCode), nullptr, 1, { { 1, PATCH_TARGET32 } } },
+    { TEMPLATE(jmpeCode), nullptr, 1, { { 15, PATCH_TARGET32 } } },
+    { TEMPLATE(jmplCode), nullptr, 1, { { 15, PATCH_TARGET32 } } },
+    { TEMPLATE(jmpgCode), nullptr, 1, { { 15, PATCH_TARGET32 } } },
+    { TEMPLATE(callCode), (void *)&baselineCall, 4, {
+        { 5, PATCH_OPERAND64 }, { 17, PATCH_ARG_BYTES32 }, { 23, PATCH_HELPER64 }, { 37, PATCH_ARG_BYTES32 } } },
+    { TEMPLATE(retCode), nullptr, 1, { { 11, PATCH_STACK_TOP32 } } },
+    { TEMPLATE(printStringCode), (void *)&baselinePrintString, 2, { { 2, PATCH_OPERAND64 }, { 12, PATCH_HELPER64 } } },
+    { TEMPLATE(printInt64Code), (void *)&baselinePrintInt64, 1, { { 10, PATCH_HELPER64 } } },
+    { TEMPLATE(currentTimeCode), (void *)&baselineCurrentTime, 1, { { 2, PATCH_HELPER64 } } },
+    { TEMPLATE(haltCode), (void *)&baselineHalt, 1, { { 2, PATCH_HELPER64 } } }
+};
+
+#define BASELINE_TEMPLATE_COUNT ((int64_t)(sizeof(bytecodeTemplates) / sizeof(BaselineTemplate)))
+
+#else
+#define BASELINE_SUPPORTED 0
+#endif
+
+/* Code is appended to the current chunk, which is only writable while a
+ * function is being copied in. Compiles happen on the interpreter thread, so
+ * nothing in the chunk runs while it is writable.
+ */
+static uint8_t *codeChunk = nullptr;
+static int64_t codeChunkSize = 0;
+static int64_t codeChunkUsed = 0;
+
+static void *installCode(const uint8_t *code, int64_t length) {
+    int64_t alignedLength = (length + 15) & ~((int64_t)15);
+    if ((nullptr == codeChunk) || (codeChunkUsed + alignedLength > codeChunkSize)) {
+        int64_t pageSize = sysconf(_SC_PAGESIZE);
+        int64_t size = (alignedLength + pageSize - 1) & ~(pageSize - 1);
+        if (size < BASELINE_CODE_CHUNK_SIZE) {
+            size = BASELINE_CODE_CHUNK_SIZE;
+        }
+        void *chunk = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == chunk) {
+            return nullptr;
+        }
+        codeChunk = (uint8_t *)chunk;
+        codeChunkSize = size;
+        codeChunkUsed = 0;
+    } else if (0 != mprotect(codeChunk, codeChunkSize, PROT_READ | PROT_WRITE)) {
+        fprintf(stderr, "Error making baseline code writable....exiting\n");
+        exit(-1);
+    }
+    uint8_t *entry = codeChunk + codeChunkUsed;
+    memcpy(entry, code, length);
+    codeChunkUsed += alignedLength;
+    if (0 != mprotect(codeChunk, codeChunkSize, PROT_READ | PROT_EXEC)) {
+        fprintf(stderr, "Error making baseline code executable....exiting\n");
+        exit(-1);
+    }
+    __builtin___clear_cache((char *)entry, (char *)entry + length);
+    return entry;
+}
+
+static bool fitsInt32(int64_t value) {
+    return (value >= INT32_MIN) && (value <= INT32_MAX);
+}
+
+void BaselineCompiler::patchInt32(int64_t position, int64_t value) {
+    int32_t narrow = (int32_t)value;
+    memcpy(&_code[position], &narrow, sizeof(narrow));
+}
+
+void BaselineCompiler::patchInt64(int64_t position, int64_t value) {
+    memcpy(&_code[position], &value, sizeof(value));
+}
+
+bool BaselineCompiler::patch(int64_t position, const BaselinePatch *patch, const BaselineTemplate *entry, int64_t index) {
+    int64_t value = 0;
+    switch (patch->kind) {
+    case PATCH_OPERAND64:
+        value = getImmediate(index, IMMEDIATE0);
+        if (Bytecodes::CALL == (Bytecodes)_function->opcodes[index]) {
+            value = (int64_t)_vm->functions[value];
+        } else if (Bytecodes::PRINT_STRING == (Bytecodes)_function->opcodes[index]) {
+            value = (int64_t)_vm->strings[value];
+        }
+        patchInt64(position, value);
+        return true;
+    case PATCH_SLOT32:
+        value = getImmediate(index, IMMEDIATE0) * (int64_t)sizeof(int64_t);
+        break;
+    case PATCH_ARG_BYTES32:
+        value = -getImmediate(index, IMMEDIATE1) * (int64_t)sizeof(int64_t);
+        break;
+    case PATCH_TARGET32:
+        _branches.push_back({ position, getImmediate(index, IMMEDIATE0) });
+        return true;
+    case PATCH_HELPER64:
+        patchInt64(position, (int64_t)entry->helper);
+        return true;
+    case PATCH_FUNCTION64:
+        patchInt64(position, (int64_t)_function);
+        return true;
+    case PATCH_LOCALS32:
+        value = _function->localCount * (int64_t)sizeof(int64_t);
+        break;
+    case PATCH_FRAME32:
+        value = (_function->localCount + _function->maxStackDepth) * (int64_t)sizeof(int64_t);
+        break;
+    case PATCH_STACK_TOP32:
+        value = offsetof(VM, stackTop);
+        break;
+    case PATCH_STACK_LIMIT32:
+        value = offsetof(VM, stackLimit);
+        break;
+    default:
+        return false;
+    }
+    if (!fitsInt32(value)) {
+        return false;
+    }
+    patchInt32(position, value);
+    return true;
+}
+
+bool BaselineCompiler::emit(const BaselineTemplate *entry, int64_t index) {
+    int64_t position = _code.size();
+    _code.insert(_code.end(), entry->code, entry->code + entry->length);
+    for (int32_t i = 0; i < entry->patchCount; i++) {
+        if (!patch(position + entry->patches[i].offset, &entry->patches[i], entry, index)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BaselineCompiler::resolveBranches() {
+    for (size_t i = 0; i < _branches.size(); i++) {
+        BaselineBranch *branch = &_branches[i];
+        if ((branch->targetIndex < 0) || (branch->targetIndex >= _function->opcodeCount) || (_offsets[branch->targetIndex] < 0)) {
+            return false;
+        }
+        /* displacements are relative to the end of the 4 byte field */
+        patchInt32(branch->patchOffset, _offsets[branch->targetIndex] - (branch->patchOffset + 4));
+    }
+    return true;
+}
+
+void *BaselineCompiler::compile() {
+#if BASELINE_SUPPORTED
+    _offsets.assign(_function->opcodeCount, -1);
+    if (!emit(&prologueTemplate, -1)) {
+        return nullptr;
+    }
+    int64_t index = 0;
+    while (index < _function->opcodeCount) {
+        int8_t opcode = _function->opcodes[index];
+        if ((opcode < 0) || (opcode >= BASELINE_TEMPLATE_COUNT)) {
+            return nullptr;
+        }
+        _offsets[index] = _code.size();
+        if ((0 != bytecodeTemplates[opcode].length) && !emit(&bytecodeTemplates[opcode], index)) {
+            return nullptr;
+        }
+        index += Bytecode::getBytecodeLength((Bytecodes)opcode);
+    }
+    if (!resolveBranches()) {
+        return nullptr;
+    }
+    return installCode(_code.data(), _code.size());
+#else
+    return nullptr;
+#endif
+}
+
+/* Runs on the interpreter thread, a failed compile leaves the function to the other tiers */
+bool compileBaselineFunction(VM *vm, Function *function) {
+    if (COMPILE_NOT_STARTED != function->baselineState) {
+        return false;
+    }
+    function->baselineState = COMPILE_FAILED;
+    if (!ensureFunctionLoaded(vm, function)) {
+        return false;
+    }
+    BaselineCompiler compiler(vm, function);
+    void *entry = compiler.compile();
+    if (nullptr == entry) {
+        return false;
+    }
+    /* a body from the optimizing tier is never replaced */
+    void *expected = nullptr;
+    __atomic_compare_exchange_n(&function->compiledFunction, &expected, entry, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    function->baselineState = COMPILE_SUCCEEDED;
+    return true;
+}
+
+/* Calls out of baseline code count invocations the same way the C interpreter does */
+int64_t baselineCall(VM *vm, Function *function, int64_t *args) {
+    if (function->invokedCount < function->compileThreshold) {
+        vm->tieringPolicy->countInvocation(vm, function);
+    }
+    CMInterpreterMethodType *compiled = (CMInterpreterMethodType *)__atomic_load_n(&function->compiledFunction, __ATOMIC_ACQUIRE);
+    if (nullptr != compiled) {
+        return compiled(vm, args);
+    }
+    BaselineInterpretType *interpret = (BaselineInterpretType *)vm->interpretFunction;
+    return interpret(vm, function, args);
+}
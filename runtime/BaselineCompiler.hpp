@@ -0,0 +1,107 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#include "EL.hpp"
+#include "Bytecodes.hpp"
+
+#ifndef BASELINECOMPILER_INCL
+#define BASELINECOMPILER_INCL
+
+/* what a template needs filled in, see BaselineCompiler::patch */
+enum {
+    PATCH_OPERAND64,    /* the bytecode's constant, Function or String */
+    PATCH_SLOT32,       /* byte offset of the local or arg the bytecode names */
+    PATCH_ARG_BYTES32,  /* minus the size of a call's args */
+    PATCH_TARGET32,     /* branch displacement to the bytecode's jump target */
+    PATCH_HELPER64,     /* address of the template's helper */
+    PATCH_FUNCTION64,   /* the function being compiled */
+    PATCH_LOCALS32,     /* size of the locals */
+    PATCH_FRAME32,      /* size of the locals and the operand stack */
+    PATCH_STACK_TOP32,  /* offset of VM::stackTop */
+    PATCH_STACK_LIMIT32 /* offset of VM::stackLimit */
+};
+
+#define BASELINE_MAX_PATCHES 8
+
+typedef struct BaselinePatch {
+    int32_t offset;
+    int32_t kind;
+} BaselinePatch;
+
+/* Machine code for one bytecode with holes at the patch offsets */
+typedef struct BaselineTemplate {
+    const uint8_t *code;
+    int32_t length;
+    void *helper;
+    int32_t patchCount;
+    BaselinePatch patches[BASELINE_MAX_PATCHES];
+} BaselineTemplate;
+
+/* Baseline tier between the interpreters and CMInterpreterMethod. Code is
+ * stitched together from a fixed x86-64 template per bytecode with no
+ * optimization, so compiling takes about as long as copying the templates.
+ * The generated function has the CMInterpreterMethodType signature and keeps
+ * its locals and operand stack on the VM stack like the interpreter does.
+ */
+class BaselineCompiler {
+public:
+    BaselineCompiler(VM *vm, Function *function) :
+        _vm(vm),
+        _function(function),
+        _code(),
+        _offsets(),
+        _branches()
+    {}
+    void *compile();
+
+private:
+    typedef struct BaselineBranch {
+        int64_t patchOffset;
+        int64_t targetIndex;
+    } BaselineBranch;
+
+    bool emit(const BaselineTemplate *entry, int64_t index);
+    bool patch(int64_t position, const BaselinePatch *patch, const BaselineTemplate *entry, int64_t index);
+    bool resolveBranches();
+    void patchInt32(int64_t position, int64_t value);
+    void patchInt64(int64_t position, int64_t value);
+
+    int64_t getImmediate(int64_t index, int64_t offset) {
+        return *((int64_t *)(_function->opcodes + index + offset));
+    }
+
+    VM *_vm;
+    Function *_function;
+    std::vector<uint8_t> _code;
+    std::vector<int64_t> _offsets; /* code offset of each bytecode index */
+    std::vector<BaselineBranch> _branches;
+};
+
+bool compileBaselineFunction(VM *vm, Function *function);
+int64_t baselineCall(VM *vm, Function *function, int64_t *args);
+
+#endif /* BASELINECOMPILER_INCL */
@@ -33,29 +33,91 @@
 #include "Bytecodes.hpp"
 #include "Helpers.hpp"
 #include "CInterpreter.hpp"
-
+#include "CMInterpreterMethod.hpp"
+#include "BaselineCompiler.hpp"
+#include "TieringPolicy.hpp"
+
+#if INTERP_CACHE_TOS
+/* The top of the operand stack lives in tos and sp points past the values
+ * below it. The bottom slot of every operand stack holds whatever tos had when
+ * the first value was pushed, so the memory part never needs a depth check.
+ */
+#define PUSH(value) \
+do { \
+    int64_t pushed = (value); \
+    *sp++ = tos; \
+    tos = pushed; \
+} while (0)
+#define POP() ({ int64_t popped = tos; tos = *--sp; popped; })
+#define PEEK() (tos)
+#define DROP() (tos = *--sp)
+/* writes tos back so the stack is contiguous in memory and answers its end */
+#define FLUSH_STACK() (*sp = tos, sp + 1)
+/* the first push spills a dead tos, so flushing a full stack writes one slot past maxStackDepth */
+#define OPERAND_STACK_SLOTS(function) ((function)->maxStackDepth + 1)
+#define POP_ARGS_AND_PUSH(argsStart, value) \
+do { \
+    sp = (argsStart); \
+    tos = (value); \
+} while (0)
+#else
 #define PUSH(value) (*sp++ = value)
 #define POP() (*--sp)
 #define PEEK() (*(sp-1))
+#define DROP() (sp -= 1)
+#define FLUSH_STACK() (sp)
+#define OPERAND_STACK_SLOTS(function) ((function)->maxStackDepth)
+#define POP_ARGS_AND_PUSH(argsStart, value) \
+do { \
+    sp = (argsStart); \
+    PUSH(value); \
+} while (0)
+#endif
 
 #if INTERP_FORCE_REGISTERS
 #define REGISTER register
-#define OPCODE_REG asm("%r15")
+#define PC_REG asm("%r15")
 #define SP_REG asm("%r14")
 #define LOCALS_REG asm("%r13")
 #define ARGS_REG asm("%r12")
+#define TOS_REG asm("%rbx")
 #else
 #define REGISTER
-#define OPCODE_REG
+#define PC_REG
 #define SP_REG
 #define LOCALS_REG
 #define ARGS_REG
+#define TOS_REG
+#endif
+
+#if INTERP_RECORD_PAIRS
+static uint64_t pairCounts[HALT + 1][HALT + 1];
+static int64_t previousOpcode = -1;
+#define RecordPair(instruction) \
+do { \
+    if (previousOpcode >= 0) { \
+        pairCounts[previousOpcode][(instruction)->opcode] += 1; \
+    } \
+    previousOpcode = (instruction)->opcode; \
+} while (0)
+#else
+#define RecordPair(instruction)
+#endif
+
+#if INTERP_PROFILE_BRANCHES
+#define ProfileBranch(condition) ((condition) ? (pc->taken += 1, true) : (pc->notTaken += 1, false))
+#else
+#define ProfileBranch(condition) (condition)
 #endif
 
 #if INTERP_USE_COMPUTED_GOTO
 #define InstructionEntry(name) &&lbl_##name
 #define Instruction(name) lbl_##name
-#define Next goto *(void *)tblArray[*opcodes]
+#if INTERP_RECORD_PAIRS
+#define Next do { RecordPair(pc); goto *pc->handler; } while (0)
+#else
+#define Next goto *pc->handler
+#endif
 #else
 #define Instruction(name) case name
 #define Next break
@@ -63,101 +125,94 @@
 
 #define doNop() \
 do { \
-    opcodes += 1; \
+    pc += 1; \
 } while (0)
 
 #define doPushConstant() \
 do { \
-    PUSH(getImmediate(opcodes, IMMEDIATE0)); \
-    opcodes += 9; \
+    PUSH(pc->operand.value); \
+    pc += 1; \
 } while (0)
 
 #define doPushArg() \
 do { \
-    PUSH(args[getImmediate(opcodes, IMMEDIATE0)]); \
-    opcodes += 9; \
+    PUSH(args[pc->operand.value]); \
+    pc += 1; \
 } while (0)
 
 #define doPushLocal() \
 do { \
-    PUSH(locals[getImmediate(opcodes, IMMEDIATE0)]); \
-    opcodes += 9; \
+    PUSH(locals[pc->operand.value]); \
+    pc += 1; \
 } while (0)
 
 #define doPop() \
 do { \
-    POP(); \
-    opcodes += 1; \
+    DROP(); \
+    pc += 1; \
 } while (0)
 
 #define doPopLocal() \
 do { \
-    locals[getImmediate(opcodes, IMMEDIATE0)] = POP(); \
-    opcodes += 9; \
+    locals[pc->operand.value] = POP(); \
+    pc += 1; \
 } while (0)
 
 #define doDup() \
 do { \
     int64_t val = PEEK(); \
     PUSH(val); \
-    opcodes += 1; \
+    pc += 1; \
 } while (0)
 
 #define doAdd() \
 do { \
     int64_t right = POP(); \
-    int64_t left = POP(); \
-    PUSH(left + right); \
-    opcodes += 1; \
+    PEEK() = PEEK() + right; \
+    pc += 1; \
 } while (0)
 
 #define doSub() \
 do { \
     int64_t right = POP(); \
-    int64_t left = POP(); \
-    PUSH(left - right); \
-    opcodes += 1; \
+    PEEK() = PEEK() - right; \
+    pc += 1; \
 } while (0)
 
 #define doMul() \
 do { \
     int64_t right = POP(); \
-    int64_t left = POP(); \
-    PUSH(left * right); \
-    opcodes += 1; \
+    PEEK() = PEEK() * right; \
+    pc += 1; \
 } while (0)
 
 #define doDiv() \
 do { \
     int64_t right = POP(); \
-    int64_t left = POP(); \
-    PUSH(left / right); \
-    opcodes += 1; \
+    PEEK() = PEEK() / right; \
+    pc += 1; \
 } while (0)
 
 #define doMod() \
 do { \
     int64_t right = POP(); \
-    int64_t left = POP(); \
-    PUSH(left % right); \
-    opcodes += 1; \
+    PEEK() = PEEK() % right; \
+    pc += 1; \
 } while (0)
 
 #define doJMP() \
 do { \
-    int64_t jumpIndex = getImmediate(opcodes, IMMEDIATE0); \
-    opcodes = &function->opcodes[jumpIndex]; \
+    pc = pc->operand.target; \
 } while(0)
 
 #define doJMPE() \
 do { \
     int64_t right = POP(); \
     int64_t left = POP(); \
-    if (left == right) { \
-        int64_t jumpIndex = getImmediate(opcodes, IMMEDIATE0); \
-        opcodes = &function->opcodes[jumpIndex]; \
+    if (ProfileBranch(left == right)) { \
+        pc = pc->operand.target; \
     } else { \
-        opcodes += 9; \
+        pc += 1; \
     } \
 } while(0)
 
@@ -165,11 +220,10 @@ do { \
 do { \
     int64_t right = POP(); \
     int64_t left = POP(); \
-    if (left < right) { \
-        int64_t jumpIndex = getImmediate(opcodes, IMMEDIATE0); \
-        opcodes = &function->opcodes[jumpIndex]; \
+    if (ProfileBranch(left < right)) { \
+        pc = pc->operand.target; \
     } else { \
-        opcodes += 9; \
+        pc += 1; \
     } \
 } while(0)
 
@@ -177,40 +231,208 @@ do { \
 do { \
     int64_t right = POP(); \
     int64_t left = POP(); \
-    int64_t jumpIndex = getImmediate(opcodes, IMMEDIATE0); \
-    if (left > right) { \
-        opcodes = &function->opcodes[jumpIndex]; \
+    if (ProfileBranch(left > right)) { \
+        pc = pc->operand.target; \
     } else { \
-        opcodes += 9; \
+        pc += 1; \
     } \
 } while(0)
 
+#define doBackEdge(header) \
+do { \
+    if ((++header->counter >= iframe->function->osrThreshold) && (sp == locals + iframe->function->localCount)) { \
+        int64_t osrResult = 0; \
+        if (attemptOSR(vm, iframe->function, header, sp, locals, args, &osrResult)) { \
+            PUSH(osrResult); \
+            goto osr_return; \
+        } \
+    } \
+    pc = header; \
+} while(0)
+
+#define doJMPBackEdge() \
+do { \
+    ThreadedInstruction *header = pc->operand.target; \
+    doBackEdge(header); \
+} while(0)
+
+#define doJMPEBackEdge() \
+do { \
+    int64_t right = POP(); \
+    int64_t left = POP(); \
+    if (ProfileBranch(left == right)) { \
+        ThreadedInstruction *header = pc->operand.target; \
+        doBackEdge(header); \
+    } else { \
+        pc += 1; \
+    } \
+} while(0)
+
+#define doJMPLBackEdge() \
+do { \
+    int64_t right = POP(); \
+    int64_t left = POP(); \
+    if (ProfileBranch(left < right)) { \
+        ThreadedInstruction *header = pc->operand.target; \
+        doBackEdge(header); \
+    } else { \
+        pc += 1; \
+    } \
+} while(0)
+
+#define doJMPGBackEdge() \
+do { \
+    int64_t right = POP(); \
+    int64_t left = POP(); \
+    if (ProfileBranch(left > right)) { \
+        ThreadedInstruction *header = pc->operand.target; \
+        doBackEdge(header); \
+    } else { \
+        pc += 1; \
+    } \
+} while(0)
+
+#define doLocalConstantAdd() \
+do { \
+    PUSH(locals[pc[0].operand.value] + pc[1].operand.value); \
+    pc += 3; \
+} while (0)
+
+#define doLocalConstantSub() \
+do { \
+    PUSH(locals[pc[0].operand.value] - pc[1].operand.value); \
+    pc += 3; \
+} while (0)
+
+#define doLocalLocalJMPL() \
+do { \
+    if (locals[pc[0].operand.value] < locals[pc[1].operand.value]) { \
+        pc = pc[2].operand.target; \
+    } else { \
+        pc += 3; \
+    } \
+} while (0)
+
+#define doLocalArgJMPG() \
+do { \
+    if (locals[pc[0].operand.value] > args[pc[1].operand.value]) { \
+        pc = pc[2].operand.target; \
+    } else { \
+        pc += 3; \
+    } \
+} while (0)
+
+#define doLocalLocal() \
+do { \
+    PUSH(locals[pc[0].operand.value]); \
+    PUSH(locals[pc[1].operand.value]); \
+    pc += 2; \
+} while (0)
+
+#define doConstantAdd() \
+do { \
+    PEEK() = PEEK() + pc[0].operand.value; \
+    pc += 2; \
+} while (0)
+
+#define doConstantPopLocal() \
+do { \
+    locals[pc[1].operand.value] = pc[0].operand.value; \
+    pc += 2; \
+} while (0)
+
+#define doConstantJMPE() \
+do { \
+    int64_t left = POP(); \
+    if (left == pc[0].operand.value) { \
+        pc = pc[1].operand.target; \
+    } else { \
+        pc += 2; \
+    } \
+} while (0)
+
+#define doConstantJMPL() \
+do { \
+    int64_t left = POP(); \
+    if (left < pc[0].operand.value) { \
+        pc = pc[1].operand.target; \
+    } else { \
+        pc += 2; \
+    } \
+} while (0)
+
+#define doDupPopLocal() \
+do { \
+    locals[pc[1].operand.value] = PEEK(); \
+    pc += 2; \
+} while (0)
+
 #define doCall() \
 do { \
-    int64_t functionID = getImmediate(opcodes, IMMEDIATE0); \
-    int64_t numberOfArgs = getImmediate(opcodes, IMMEDIATE1); \
-    Function *toCall = vm->functions[functionID]; \
-    int64_t *newArgs = sp - numberOfArgs; \
-    frame->stack = sp; \
-    CInterpreter interp; \
-    int64_t ret = interp.interpret(vm, toCall, newArgs); \
-    sp = newArgs; /*effectively popping the args off of s=the stack */\
-    PUSH(ret); \
-    opcodes += 17; \
+    Function *toCall = pc->operand.function; \
+    int64_t *stackEnd = FLUSH_STACK(); \
+    if (toCall->invokedCount < toCall->compileThreshold) { \
+        vm->stackTop = stackEnd; \
+        vm->tieringPolicy->countInvocation(vm, toCall); \
+    } \
+    CMInterpreterMethodType *compiled = (CMInterpreterMethodType *)__atomic_load_n(&toCall->compiledFunction, __ATOMIC_ACQUIRE); \
+    if (nullptr != compiled) { \
+        int64_t *newArgs = stackEnd - pc->argCount; \
+        vm->stackTop = stackEnd; /* frames pushed by compiled code go above the current frame */ \
+        int64_t ret = compiled(vm, newArgs); \
+        POP_ARGS_AND_PUSH(newArgs, ret); \
+        pc += 1; \
+    } else { \
+        ThreadedInstruction *callee = (ThreadedInstruction *)toCall->threadedCode; \
+        if (nullptr == callee) { \
+            callee = translateFunction(vm, toCall, tblArray); \
+        } \
+        InterpreterFrame *newFrame = (InterpreterFrame *)stackEnd; \
+        int64_t *newLocals = (int64_t *)(newFrame + 1); \
+        int64_t *newStack = newLocals + toCall->localCount; \
+        if (newStack + OPERAND_STACK_SLOTS(toCall) > vm->stackLimit) { \
+            fprintf(stderr, "VM stack overflow calling function %s....exiting\n", toCall->functionName); \
+            exit(-1); \
+        } \
+        newFrame->previous = iframe; \
+        newFrame->function = toCall; \
+        newFrame->returnPC = pc + 1; \
+        newFrame->args = stackEnd - pc->argCount; \
+        iframe = newFrame; \
+        args = newFrame->args; \
+        locals = newLocals; \
+        sp = newStack; \
+        pc = callee; \
+    } \
+} while(0)
+
+#define doRet() \
+do { \
+    int64_t retVal = POP(); \
+    if (nullptr == iframe->previous) { \
+        vm->stackTop = (int64_t *)iframe; \
+        vm->frame = frame->previous; \
+        return retVal; \
+    } \
+    int64_t *callerStackEnd = iframe->args; /* pops the callee's args off of the caller's stack */ \
+    pc = iframe->returnPC; \
+    iframe = iframe->previous; \
+    args = iframe->args; \
+    locals = (int64_t *)(iframe + 1); \
+    POP_ARGS_AND_PUSH(callerStackEnd, retVal); \
 } while(0)
 
 #define doPrintString() \
 do { \
-    int64_t stringID = getImmediate(opcodes, IMMEDIATE0); \
-    String *string = vm->strings[stringID]; \
+    String *string = pc->operand.string; \
     fprintf(stdout, "%.*s", (int32_t)string->length, string->data); \
-    opcodes += 9; \
+    pc += 1; \
 } while (0)
 
 #define doPrintInt64() \
 do { \
     fprintf(stdout, "%" PRIu64, POP()); \
-    opcodes += 1; \
+    pc += 1; \
 } while (0)
 
 #define doCurrentTime() \
@@ -219,7 +441,7 @@ do { \
     gettimeofday(&tp, NULL); \
     int64_t time = ((int64_t)tp.tv_sec) * 1000 + tp.tv_usec / 1000; \
     PUSH(time); \
-    opcodes += 1; \
+    pc += 1; \
 } while (0)
 
 #define doHalt() \
@@ -227,32 +449,289 @@ do { \
     exit(0); \
 } while (0)
 
+/* Longer sequences come first so they win over the pairs they start with.
+ * The position of an entry is its bit in VM::superinstructions.
+ */
+static const Superinstruction superinstructionTable[] = {
+    { LOCAL_CONSTANT_ADD, 3, { PUSH_LOCAL, PUSH_CONSTANT, ADD } },
+    { LOCAL_CONSTANT_SUB, 3, { PUSH_LOCAL, PUSH_CONSTANT, SUB } },
+    { LOCAL_LOCAL_JMPL, 3, { PUSH_LOCAL, PUSH_LOCAL, JMPL } },
+    { LOCAL_ARG_JMPG, 3, { PUSH_LOCAL, PUSH_ARG, JMPG } },
+    { LOCAL_LOCAL, 2, { PUSH_LOCAL, PUSH_LOCAL } },
+    { CONSTANT_ADD, 2, { PUSH_CONSTANT, ADD } },
+    { CONSTANT_POP_LOCAL, 2, { PUSH_CONSTANT, POP_LOCAL } },
+    { CONSTANT_JMPE, 2, { PUSH_CONSTANT, JMPE } },
+    { CONSTANT_JMPL, 2, { PUSH_CONSTANT, JMPL } },
+    { DUP_POP_LOCAL, 2, { DUP, POP_LOCAL } }
+};
+
+#define SUPERINSTRUCTION_COUNT ((int64_t)(sizeof(superinstructionTable) / sizeof(Superinstruction)))
+
+/* Keeps the superinstructions whose every opcode pair is common in the
+ * recorded profile. Each line of the profile is "<opcode> <opcode> <count>".
+ */
+uint64_t selectSuperinstructions(const char *profileFileName) {
+    FILE *profile = fopen(profileFileName, "r");
+    if (NULL == profile) {
+        fprintf(stderr, "Error opening opcode pair profile %s\n", profileFileName);
+        return 0;
+    }
+    uint64_t counts[HALT + 1][HALT + 1];
+    memset(counts, 0, sizeof(counts));
+    uint64_t total = 0;
+    char first[32];
+    char second[32];
+    uint64_t count = 0;
+    while (3 == fscanf(profile, "%31s %31s %" SCNu64, first, second, &count)) {
+        Bytecodes firstOpcode = Bytecode::getBytecode(first);
+        Bytecodes secondOpcode = Bytecode::getBytecode(second);
+        if ((Bytecodes::ERROR == firstOpcode) || (Bytecodes::ERROR == secondOpcode)) {
+            fprintf(stderr, "Unknown opcode pair %s %s in %s\n", first, second, profileFileName);
+            continue;
+        }
+        counts[(int32_t)firstOpcode][(int32_t)secondOpcode] += count;
+        total += count;
+    }
+    fclose(profile);
+
+    uint64_t selected = 0;
+    for (int64_t i = 0; i < SUPERINSTRUCTION_COUNT; i++) {
+        const Superinstruction *superinstruction = &superinstructionTable[i];
+        bool common = true;
+        for (int32_t j = 1; j < superinstruction->length; j++) {
+            uint64_t pairCount = counts[superinstruction->opcodes[j - 1]][superinstruction->opcodes[j]];
+            if ((0 == pairCount) || (pairCount * SUPERINSTRUCTION_PAIR_SHARE < total)) {
+                common = false;
+            }
+        }
+        if (common) {
+            selected |= ((uint64_t)1) << i;
+        }
+    }
+    return selected;
+}
+
+bool writePairProfile(const char *profileFileName) {
+#if INTERP_RECORD_PAIRS
+    FILE *profile = fopen(profileFileName, "w");
+    if (NULL == profile) {
+        fprintf(stderr, "Error opening opcode pair profile %s\n", profileFileName);
+        return false;
+    }
+    for (int32_t first = 0; first <= HALT; first++) {
+        for (int32_t second = 0; second <= HALT; second++) {
+            if (0 != pairCounts[first][second]) {
+                fprintf(profile, "%s %s %" PRIu64 "\n", Bytecode::getBytecodeName((Bytecodes)first),
+                        Bytecode::getBytecodeName((Bytecodes)second), pairCounts[first][second]);
+            }
+        }
+    }
+    fclose(profile);
+    return true;
+#else
+    fprintf(stderr, "Recording opcode pairs needs a build with INTERP_RECORD_PAIRS\n");
+    return false;
+#endif
+}
+
 CInterpreter::CInterpreter() {}
 
-int64_t CInterpreter::interpret(VM *vm, Function *function, int64_t *a) {
-    Frame f;
-    Frame *frame = &f;
-    int64_t stackSize = function->maxStackDepth * sizeof(int64_t);
-    int64_t localsSize = function->localCount * sizeof(int64_t);
-    int64_t *data = nullptr;
-    if (function->maxStackDepth + function->localCount <= FRAME_INLINED_DATA_LENGTH) {
-        frame->stack = f.inlinedData;
-        frame->locals = frame->stack + function->maxStackDepth;
-    } else {
-        data = allocateFrameData(function, stackSize, localsSize);
-        frame->stack = data;
-        frame->locals = (int64_t*)((int8_t*)data + stackSize);
+int64_t CInterpreter::getBytecodeIndex(Function *function, ThreadedInstruction *instruction) {
+    ThreadedInstruction *slot = (ThreadedInstruction *)function->threadedCode;
+    int64_t index = 0;
+    while (slot < instruction) {
+        index += Bytecode::getBytecodeLength((Bytecodes)function->opcodes[index]);
+        slot += 1;
     }
-    frame->args = a;
+    return index;
+}
 
-    frame->previous = vm->frame;
-    vm->frame = frame;
+bool CInterpreter::attemptOSR(VM *vm, Function *function, ThreadedInstruction *header, int64_t *sp, int64_t *locals, int64_t *args, int64_t *result) {
+    int64_t bytecodeIndex = getBytecodeIndex(function, header);
+    vm->stackTop = sp;
+    if (-1 == function->osrBytecodeIndex) {
+        compileOSRFunction(vm, function, bytecodeIndex);
+    }
+    if (bytecodeIndex != function->osrBytecodeIndex) {
+        /* only one loop per function gets an OSR body, stop counting this one */
+        header->counter = INT64_MIN;
+        return false;
+    }
+    CMInterpreterOSRMethodType *osrMethod = (CMInterpreterOSRMethodType *)__atomic_load_n(&function->osrFunction, __ATOMIC_ACQUIRE);
+    if (nullptr == osrMethod) {
+        if (COMPILE_QUEUED == __atomic_load_n(&function->osrCompileState, __ATOMIC_ACQUIRE)) {
+            /* still compiling in the background, check again after another round of back edges */
+            header->counter = 0;
+        } else {
+            header->counter = INT64_MIN;
+        }
+        return false;
+    }
+    *result = osrMethod(vm, args, locals);
+    return true;
+}
+
+
+ThreadedInstruction *CInterpreter::translateFunction(VM *vm, Function *function, const void * const *handlers) {
+    if (!ensureFunctionLoaded(vm, function)) {
+        fprintf(stderr, "Error loading function %s....exiting\n", function->functionName);
+        exit(-1);
+    }
+    int64_t opcodeCount = function->opcodeCount;
+    int8_t *opcodes = function->opcodes;
 
-    REGISTER int8_t *opcodes OPCODE_REG = function->opcodes;
-    REGISTER int64_t *sp SP_REG = frame->stack;
-    REGISTER int64_t *locals LOCALS_REG = frame->locals;
-    REGISTER int64_t *args ARGS_REG = frame->args;
+    int64_t *slotIndices = (int64_t *)malloc(opcodeCount * sizeof(int64_t));
+    if (nullptr == slotIndices) {
+        fprintf(stderr, "Error allocating threaded code for function %s....exiting\n", function->functionName);
+        exit(-1);
+    }
+
+    bool *jumpTargets = (bool *)calloc(opcodeCount, sizeof(bool));
+    if (nullptr == jumpTargets) {
+        fprintf(stderr, "Error allocating threaded code for function %s....exiting\n", function->functionName);
+        exit(-1);
+    }
+
+    int64_t instructionCount = 0;
+    int64_t index = 0;
+    while (index < opcodeCount) {
+        slotIndices[index] = instructionCount++;
+        int8_t opcode = opcodes[index];
+        if ((opcode >= JMP) && (opcode <= JMPG)) {
+            int64_t jumpIndex = getImmediate(opcodes + index, IMMEDIATE0);
+            if ((jumpIndex >= 0) && (jumpIndex < opcodeCount)) {
+                jumpTargets[jumpIndex] = true;
+            }
+        }
+        int64_t length = Bytecode::getBytecodeLength((Bytecodes)opcode);
+        for (int64_t i = 1; i < length && index + i < opcodeCount; i++) {
+            slotIndices[index + i] = -1;
+        }
+        index += length;
+    }
 
+    ThreadedInstruction *code = (ThreadedInstruction *)malloc(instructionCount * sizeof(ThreadedInstruction));
+    if (nullptr == code) {
+        fprintf(stderr, "Error allocating threaded code for function %s....exiting\n", function->functionName);
+        exit(-1);
+    }
+
+    ThreadedInstruction *slot = code;
+    index = 0;
+    while (index < opcodeCount) {
+        int8_t opcode = opcodes[index];
+        slot->handler = getHandler(handlers, opcode);
+        slot->operand.value = 0;
+        slot->argCount = 0;
+        slot->counter = 0;
+#if INTERP_RECORD_PAIRS
+        slot->opcode = opcode;
+#endif
+#if INTERP_PROFILE_BRANCHES
+        slot->taken = 0;
+        slot->notTaken = 0;
+#endif
+
+        switch ((Bytecodes)opcode) {
+        case Bytecodes::PUSH_CONSTANT:
+        case Bytecodes::PUSH_ARG:
+        case Bytecodes::PUSH_LOCAL:
+        case Bytecodes::POP_LOCAL:
+            slot->operand.value = getImmediate(opcodes + index, IMMEDIATE0);
+            break;
+        case Bytecodes::JMP:
+        case Bytecodes::JMPE:
+        case Bytecodes::JMPL:
+        case Bytecodes::JMPG:
+        {
+            int64_t jumpIndex = getImmediate(opcodes + index, IMMEDIATE0);
+            if (jumpIndex < 0 || jumpIndex >= opcodeCount || slotIndices[jumpIndex] < 0) {
+                fprintf(stderr, "Invalid jump target %" PRIu64 " at index %" PRIu64 " in function %s....exiting\n", jumpIndex, index, function->functionName);
+                exit(-1);
+            }
+            slot->operand.target = &code[slotIndices[jumpIndex]];
+            if (vm->jitEnabled && (jumpIndex <= index)) {
+                int32_t backEdge = JMP_BACKEDGE + (opcode - JMP);
+                slot->handler = getHandler(handlers, backEdge);
+            }
+            break;
+        }
+        case Bytecodes::CALL:
+            slot->operand.function = vm->functions[getImmediate(opcodes + index, IMMEDIATE0)];
+            slot->argCount = getImmediate(opcodes + index, IMMEDIATE1);
+            break;
+        case Bytecodes::PRINT_STRING:
+            slot->operand.string = vm->strings[getImmediate(opcodes + index, IMMEDIATE0)];
+            break;
+        default:
+            break;
+        }
+
+        index += Bytecode::getBytecodeLength((Bytecodes)opcode);
+        slot += 1;
+    }
+
+#if INTERP_USE_SUPERINSTRUCTIONS && !INTERP_RECORD_PAIRS && !INTERP_PROFILE_BRANCHES
+    fuseSuperinstructions(vm, function, code, jumpTargets, handlers);
+#endif
+
+    free(jumpTargets);
+    free(slotIndices);
+    function->threadedCode = (void *)code;
+    return code;
+}
+
+/* Only the handlers change, Function::opcodes stays canonical for the JIT and dumpProgram */
+void CInterpreter::fuseSuperinstructions(VM *vm, Function *function, ThreadedInstruction *code, bool *jumpTargets, const void * const *handlers) {
+    int8_t *opcodes = function->opcodes;
+    ThreadedInstruction *slot = code;
+    int64_t index = 0;
+    while (index < function->opcodeCount) {
+        int64_t length = 1;
+        int64_t entry = findSuperinstruction(vm, function, index, jumpTargets);
+        if (entry >= 0) {
+            int32_t handler = superinstructionTable[entry].handler;
+            slot->handler = getHandler(handlers, handler);
+            length = superinstructionTable[entry].length;
+        }
+        for (int64_t i = 0; i < length; i++) {
+            index += Bytecode::getBytecodeLength((Bytecodes)opcodes[index]);
+        }
+        slot += length;
+    }
+}
+
+int64_t CInterpreter::findSuperinstruction(VM *vm, Function *function, int64_t index, bool *jumpTargets) {
+    int8_t *opcodes = function->opcodes;
+    for (int64_t entry = 0; entry < SUPERINSTRUCTION_COUNT; entry++) {
+        if (0 == (vm->superinstructions & (((uint64_t)1) << entry))) {
+            continue;
+        }
+        const Superinstruction *superinstruction = &superinstructionTable[entry];
+        int64_t position = index;
+        bool matches = true;
+        for (int32_t i = 0; matches && (i < superinstruction->length); i++) {
+            /* nothing may jump into the middle of a fused sequence */
+            if ((position >= function->opcodeCount) || (opcodes[position] != superinstruction->opcodes[i])
+                || ((i > 0) && jumpTargets[position])) {
+                matches = false;
+                break;
+            }
+            int8_t opcode = opcodes[position];
+            /* back edges keep their own handlers so OSR still sees them */
+            if (vm->jitEnabled && (opcode >= JMP) && (opcode <= JMPG) && (getImmediate(opcodes + position, IMMEDIATE0) <= position)) {
+                matches = false;
+            }
+            position += Bytecode::getBytecodeLength((Bytecodes)opcode);
+        }
+        if (matches) {
+            return entry;
+        }
+    }
+    return -1;
+}
+
+int64_t CInterpreter::interpret(VM *vm, Function *function, int64_t *a) {
 #if INTERP_USE_COMPUTED_GOTO
     static const void * const tblArray[] = {
             InstructionEntry(NOP),
@@ -276,12 +755,66 @@ int64_t CInterpreter::interpret(VM *vm, Function *function, int64_t *a) {
             InstructionEntry(PRINT_STRING),
             InstructionEntry(PRINT_INT64),
             InstructionEntry(CURRENT_TIME),
-            InstructionEntry(HALT)
+            InstructionEntry(HALT),
+            InstructionEntry(JMP_BACKEDGE),
+            InstructionEntry(JMPE_BACKEDGE),
+            InstructionEntry(JMPL_BACKEDGE),
+            InstructionEntry(JMPG_BACKEDGE),
+            InstructionEntry(LOCAL_CONSTANT_ADD),
+            InstructionEntry(LOCAL_CONSTANT_SUB),
+            InstructionEntry(LOCAL_LOCAL_JMPL),
+            InstructionEntry(LOCAL_ARG_JMPG),
+            InstructionEntry(LOCAL_LOCAL),
+            InstructionEntry(CONSTANT_ADD),
+            InstructionEntry(CONSTANT_POP_LOCAL),
+            InstructionEntry(CONSTANT_JMPE),
+            InstructionEntry(CONSTANT_JMPL),
+            InstructionEntry(DUP_POP_LOCAL)
     };
-    goto *tblArray[*opcodes];
+#else
+    static const void * const *tblArray = nullptr;
+#endif
+
+    ThreadedInstruction *code = (ThreadedInstruction *)function->threadedCode;
+    if (nullptr == code) {
+        code = translateFunction(vm, function, tblArray);
+    }
+
+    InterpreterFrame *iframe = (InterpreterFrame *)vm->stackTop;
+    int64_t *entryLocals = (int64_t *)(iframe + 1);
+    int64_t *entryStack = entryLocals + function->localCount;
+    if (entryStack + OPERAND_STACK_SLOTS(function) > vm->stackLimit) {
+        fprintf(stderr, "VM stack overflow calling function %s....exiting\n", function->functionName);
+        exit(-1);
+    }
+    iframe->previous = nullptr;
+    iframe->function = function;
+    iframe->returnPC = nullptr;
+    iframe->args = a;
+
+    Frame f;
+    Frame *frame = &f;
+    frame->function = function;
+    frame->stack = entryStack;
+    frame->locals = entryLocals;
+    frame->args = a;
+    frame->previous = vm->frame;
+    vm->frame = frame;
+
+    REGISTER ThreadedInstruction *pc PC_REG = code;
+    REGISTER int64_t *sp SP_REG = entryStack;
+    REGISTER int64_t *locals LOCALS_REG = entryLocals;
+    REGISTER int64_t *args ARGS_REG = a;
+#if INTERP_CACHE_TOS
+    REGISTER int64_t tos TOS_REG = 0;
+#endif
+
+#if INTERP_USE_COMPUTED_GOTO
+    Next;
 #else
     while (true) {
-        switch(*opcodes) {
+        RecordPair(pc);
+        switch((intptr_t)pc->handler) {
 #endif
         Instruction(NOP):
         {
@@ -370,12 +903,9 @@ int64_t CInterpreter::interpret(VM *vm, Function *function, int64_t *a) {
         }
         Instruction(RET):
         {
-            int64_t retVal = POP();
-            vm->frame = frame->previous;
-            if (nullptr != data) {
-                freeFrameData(data);
-            }
-            return retVal;
+osr_return:
+            doRet();
+            Next;
         }
         Instruction(PRINT_STRING):
         {
@@ -396,12 +926,87 @@ int64_t CInterpreter::interpret(VM *vm, Function *function, int64_t *a) {
         {
             doHalt();
         }
+        Instruction(JMP_BACKEDGE):
+        {
+            doJMPBackEdge();
+            Next;
+        }
+        Instruction(JMPE_BACKEDGE):
+        {
+            doJMPEBackEdge();
+            Next;
+        }
+        Instruction(JMPL_BACKEDGE):
+        {
+            doJMPLBackEdge();
+            Next;
+        }
+        Instruction(JMPG_BACKEDGE):
+        {
+            doJMPGBackEdge();
+            Next;
+        }
+        Instruction(LOCAL_CONSTANT_ADD):
+        {
+            doLocalConstantAdd();
+            Next;
+        }
+        Instruction(LOCAL_CONSTANT_SUB):
+        {
+            doLocalConstantSub();
+            Next;
+        }
+        Instruction(LOCAL_LOCAL_JMPL):
+        {
+            doLocalLocalJMPL();
+            Next;
+        }
+        Instruction(LOCAL_ARG_JMPG):
+        {
+            doLocalArgJMPG();
+            Next;
+        }
+        Instruction(LOCAL_LOCAL):
+        {
+            doLocalLocal();
+            Next;
+        }
+        Instruction(CONSTANT_ADD):
+        {
+            doConstantAdd();
+            Next;
+        }
+        Instruction(CONSTANT_POP_LOCAL):
+        {
+            doConstantPopLocal();
+            Next;
+        }
+        Instruction(CONSTANT_JMPE):
+        {
+            doConstantJMPE();
+            Next;
+        }
+        Instruction(CONSTANT_JMPL):
+        {
+            doConstantJMPL();
+            Next;
+        }
+        Instruction(DUP_POP_LOCAL):
+        {
+            doDupPopLocal();
+            Next;
+        }
 #if INTERP_USE_COMPUTED_GOTO==0
         default:
-            fprintf(stderr, "Unknown opcode  %d during execution. Exiting...\n", *opcodes);
+            fprintf(stderr, "Unknown opcode  %d during execution. Exiting...\n", (int32_t)(intptr_t)pc->handler);
             exit(-1);
         }
     }
 #endif
     /* unreachable*/
 }
+
+int64_t c_interpret(VM *vm, Function *function, int64_t *args) {
+    CInterpreter interp;
+    return interp.interpret(vm, function, args);
+}
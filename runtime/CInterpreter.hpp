@@ -56,19 +56,97 @@ enum {
     PRINT_STRING,
     PRINT_INT64,
     CURRENT_TIME,
-    HALT
+    HALT,
+    /* threaded code only: backward jumps that count loop header executions for OSR */
+    JMP_BACKEDGE,
+    JMPE_BACKEDGE,
+    JMPL_BACKEDGE,
+    JMPG_BACKEDGE,
+    /* threaded code only: fused sequences, see superinstructionTable */
+    LOCAL_CONSTANT_ADD,
+    LOCAL_CONSTANT_SUB,
+    LOCAL_LOCAL_JMPL,
+    LOCAL_ARG_JMPG,
+    LOCAL_LOCAL,
+    CONSTANT_ADD,
+    CONSTANT_POP_LOCAL,
+    CONSTANT_JMPE,
+    CONSTANT_JMPL,
+    DUP_POP_LOCAL
 };
 
+#define SUPERINSTRUCTION_MAX_LENGTH 3
+
+/* A superinstruction handler sits in the slot of the first bytecode it covers
+ * and reads the operands of the following slots, which are translated as
+ * usual. Slots stay one per bytecode so bytecode indices can still be mapped.
+ */
+typedef struct Superinstruction {
+    int32_t handler;
+    int32_t length;
+    int8_t opcodes[SUPERINSTRUCTION_MAX_LENGTH];
+} Superinstruction;
+
+/* Pre-decoded form of a single bytecode. Immediates are widened and aligned at
+ * translation time and jump, call and string operands are resolved to pointers
+ * so the dispatch loop never has to look at Function::opcodes.
+ */
+typedef struct ThreadedInstruction {
+    const void *handler;
+    union {
+        int64_t value;
+        struct ThreadedInstruction *target;
+        Function *function;
+        String *string;
+    } operand;
+    int64_t argCount;
+    int64_t counter; /* back-edge count when this instruction is a loop header */
+#if INTERP_RECORD_PAIRS
+    int64_t opcode;
+#endif
+#if INTERP_PROFILE_BRANCHES
+    int64_t taken; /* conditional jumps only */
+    int64_t notTaken;
+#endif
+} ThreadedInstruction;
+
+/* Header of an interpreted activation on the VM stack. The callee's locals and
+ * operand stack are laid out directly after it and its args are the top slots
+ * of the caller's operand stack directly before it.
+ */
+typedef struct InterpreterFrame {
+    struct InterpreterFrame *previous;
+    Function *function;
+    ThreadedInstruction *returnPC;
+    int64_t *args;
+} InterpreterFrame;
+
+#define INTERPRETER_FRAME_SLOTS (sizeof(InterpreterFrame) / sizeof(int64_t))
+
 class CInterpreter {
 public:
     CInterpreter();
     int64_t interpret(VM *vm, Function *func, int64_t* args);
+    /* handlers is indexed by the enum above, null stores the enum values for switch dispatch */
+    ThreadedInstruction *translateFunction(VM *vm, Function *function, const void * const *handlers);
 
 private:
+    void fuseSuperinstructions(VM *vm, Function *function, ThreadedInstruction *code, bool *jumpTargets, const void * const *handlers);
+    int64_t findSuperinstruction(VM *vm, Function *function, int64_t index, bool *jumpTargets);
+    int64_t getBytecodeIndex(Function *function, ThreadedInstruction *instruction);
+    bool attemptOSR(VM *vm, Function *function, ThreadedInstruction *header, int64_t *sp, int64_t *locals, int64_t *args, int64_t *result);
+
+    const void *getHandler(const void * const *handlers, int32_t opcode) {
+        return (nullptr != handlers) ? handlers[opcode] : (const void *)(intptr_t)opcode;
+    }
 
     int64_t getImmediate(int8_t *opcodes, int64_t offset) {
         return *((int64_t *)((int8_t *)opcodes + offset));
     }
 };
 
+int64_t c_interpret(VM *vm, Function *function, int64_t *args);
+uint64_t selectSuperinstructions(const char *profileFileName);
+bool writePairProfile(const char *profileFileName);
+
 #endif /*CINTERPRETER_INCL */
@@ -39,6 +39,7 @@
 #include "CompiledMethodBuilder.hpp"
 #include "RuntimeBuilder.hpp"
 #include "IBInterpreter.hpp"
+#include "TieringPolicy.hpp"
 
 using OMR::JitBuilder::BytecodeBuilder;
 using OMR::JitBuilder::IlType;
@@ -84,13 +85,35 @@ void CMInterpreterMethod::Setup() {
         argsArray->Reload(this);
     }
 
+    if (_osrBytecodeIndex >= 0) {
+        // Transfer the interpreted frame's locals, doOSREntry resumes at the loop header.
+        // The interpreter only requests OSR when the operand stack is empty.
+        for (int64_t i = 0; i < _function->localCount; i++) {
+            StoreAt(
+                IndexAt(types->pInt64, Load("compiled_locals"), ConstInt64(i)),
+                LoadAt(types->pInt64,
+                    IndexAt(types->pInt64, Load("osrLocals"), ConstInt64(i))));
+        }
+        localsArray->Reload(this);
+    }
+
     InterpreterVMState *vmState = new InterpreterVMState(stack, stackRegister, localsArray, localsRegister, argsArray, argsRegister);
     setVMState(vmState);
+
+    if (JIT_LEVEL_WARM == _level) {
+        countTowardsRecompile(this, "compiledInvokedCount", _vm->tieringPolicy->recompileInvocations());
+    }
 }
 
-CMInterpreterMethod::CMInterpreterMethod(TypeDictionary *types, VM *vm, Function *func)
+CMInterpreterMethod::CMInterpreterMethod(TypeDictionary *types, VM *vm, Function *func, int64_t osrBytecodeIndex, int64_t level)
     : CompiledMethodBuilder(types, (void *)func->opcodes, 1),
-    _function(func)
+    _vm(vm),
+    _function(func),
+    _osrBytecodeIndex(osrBytecodeIndex),
+    _level(level),
+    _name(func->functionName),
+    _inlinedSize(0),
+    _inlineCount(0)
 {
     DefineLine(LINETOSTR(__LINE__));
     DefineFile(__FILE__);
@@ -98,10 +121,16 @@ CMInterpreterMethod::CMInterpreterMethod(TypeDictionary *types, VM *vm, Function
     IlType *VMType = types->LookupStruct("VM");
     IlType *pVMType = types->PointerTo(VMType);
 
-    DefineName(func->functionName);
+    if (_osrBytecodeIndex >= 0) {
+        _name += "_osr" + std::to_string(_osrBytecodeIndex);
+    }
+    DefineName(_name.c_str());
 
     DefineParameter("vm", pVMType);
     DefineParameter("a", types->pInt64);
+    if (_osrBytecodeIndex >= 0) {
+        DefineParameter("osrLocals", types->pInt64);
+    }
     DefineReturnType(Int64);
 
     DefineLocal("sp", types->pInt64);
@@ -111,11 +140,530 @@ CMInterpreterMethod::CMInterpreterMethod(TypeDictionary *types, VM *vm, Function
     DefineFunction((char *)"ib_interpret",
                   (char *)__FILE__,
                   (char *)LINETOSTR(__LINE__),
-                  (void *)&vm->interpretFunction,
+                  vm->interpretFunction,
                   Int64,
-                  1,
-                  pVMType);
+                  3,
+                  pVMType,
+                  types->PointerTo(types->LookupStruct("Function")),
+                  types->pInt64);
+
+    DefineFunction((char *)"callInterpretedFunction",
+                  (char *)__FILE__,
+                  (char *)LINETOSTR(__LINE__),
+                  (void *)&callInterpretedFunction,
+                  Int64,
+                  3,
+                  pVMType,
+                  types->PointerTo(types->LookupStruct("Function")),
+                  types->pInt64);
+
+    DefineFunction((char *)"recompileFunction",
+                  (char *)__FILE__,
+                  (char *)LINETOSTR(__LINE__),
+                  (void *)&recompileFunction,
+                  NoType,
+                  2,
+                  pVMType,
+                  types->PointerTo(types->LookupStruct("Function")));
+
+    defineDirectCallees();
 
     IBInterpreter::defineFunctions(this, types);
-    IBInterpreter::registerHandlers(this);
+    for (int32_t opcode = 0; opcode < (int32_t)Bytecodes::ERROR; opcode++) {
+        RegisterHandler(opcode, Bytecode::getBytecodeName((Bytecodes)opcode), handler((Bytecodes)opcode));
+    }
+    if (_osrBytecodeIndex > 0) {
+        Bytecodes entry = (Bytecodes)_function->opcodes[0];
+        RegisterHandler((int32_t)entry, Bytecode::getBytecodeName(entry), (void *)&CMInterpreterMethod::doOSREntry);
+    }
+}
+
+void *CMInterpreterMethod::handler(Bytecodes opcode) {
+    if (Bytecodes::CALL == opcode) {
+        return (void *)&CMInterpreterMethod::doCall;
+    }
+    if (JIT_LEVEL_WARM == _level) {
+        switch (opcode) {
+            case Bytecodes::JMP: return (void *)&CMInterpreterMethod::doCountedJMP;
+            case Bytecodes::JMPE: return (void *)&CMInterpreterMethod::doCountedJMPE;
+            case Bytecodes::JMPL: return (void *)&CMInterpreterMethod::doCountedJMPL;
+            case Bytecodes::JMPG: return (void *)&CMInterpreterMethod::doCountedJMPG;
+            default: break;
+        }
+    }
+    return IBInterpreter::handler(opcode);
+}
+
+/* OSR bodies are entered at bytecode 0 with the locals from Setup and jump to
+ * the loop header from there, the same way a JMP handler does. Every other
+ * bytecode that shares the opcode at 0 gets its usual handler, compileOSRFunction
+ * does not ask for a body when something else jumps to bytecode 0.
+ */
+int64_t CMInterpreterMethod::doOSREntry(RuntimeBuilder *rb, IlBuilder *b) {
+    CMInterpreterMethod *method = (CMInterpreterMethod *)rb;
+    int64_t index = ((BytecodeBuilder *)b)->bcIndex();
+    if (0 == index) {
+        rb->Jump(b, b->ConstInt64(method->_osrBytecodeIndex), false);
+        return 0;
+    }
+    IBHandlerType *handler = (IBHandlerType *)method->handler((Bytecodes)method->_function->opcodes[index]);
+    return handler(rb, b);
+}
+
+/* Warm bodies count their own invocations and back edges in the Function and
+ * ask for a hot recompile the first time either reaches its threshold. The
+ * hot body is published through compiledFunction, which repoints every caller
+ * that does not bind to it directly.
+ */
+void CMInterpreterMethod::countTowardsRecompile(IlBuilder *b, const char *counter, int64_t threshold) {
+    b->Store("recompileCount",
+    b->     Add(
+    b->        LoadIndirect("Function", counter,
+    b->                    ConstAddress(_function)),
+    b->        ConstInt64(1)));
+
+    b->StoreIndirect("Function", counter,
+    b->             ConstAddress(_function),
+    b->             Load("recompileCount"));
+
+    IlBuilder *recompile = nullptr;
+    b->IfThen(&recompile,
+    b->       EqualTo(
+    b->              Load("recompileCount"),
+    b->              ConstInt64(threshold)));
+
+    recompile->Call("recompileFunction", 2, recompile->Load("vm"), recompile->ConstAddress(_function));
+}
+
+void CMInterpreterMethod::countBackEdge(IlBuilder *b) {
+    int64_t index = ((BytecodeBuilder *)b)->bcIndex();
+    int64_t target = *(int64_t *)(_function->opcodes + index + IMMEDIATE0);
+    if (target <= index) {
+        countTowardsRecompile(b, "compiledBackEdgeCount", _vm->tieringPolicy->recompileBackEdges());
+    }
+}
+
+int64_t CMInterpreterMethod::doCountedJMP(RuntimeBuilder *rb, IlBuilder *b) {
+    ((CMInterpreterMethod *)rb)->countBackEdge(b);
+    return doJMP(rb, b);
+}
+
+int64_t CMInterpreterMethod::doCountedJMPE(RuntimeBuilder *rb, IlBuilder *b) {
+    ((CMInterpreterMethod *)rb)->countBackEdge(b);
+    return doJMPE(rb, b);
+}
+
+int64_t CMInterpreterMethod::doCountedJMPL(RuntimeBuilder *rb, IlBuilder *b) {
+    ((CMInterpreterMethod *)rb)->countBackEdge(b);
+    return doJMPL(rb, b);
+}
+
+int64_t CMInterpreterMethod::doCountedJMPG(RuntimeBuilder *rb, IlBuilder *b) {
+    ((CMInterpreterMethod *)rb)->countBackEdge(b);
+    return doJMPG(rb, b);
+}
+
+void CMInterpreterMethod::defineDirectCallees() {
+    TypeDictionary *types = typeDictionary();
+    IlType *pVMType = types->PointerTo(types->LookupStruct("VM"));
+    int8_t *opcodes = _function->opcodes;
+    int64_t index = 0;
+    while (index < _function->opcodeCount) {
+        Bytecodes opcode = (Bytecodes)opcodes[index];
+        if (Bytecodes::CALL == opcode) {
+            Function *callee = _vm->functions[*(int64_t *)(opcodes + index + IMMEDIATE0)];
+            /* baseline and warm bodies get replaced, so only bind directly to hot ones */
+            void *entry = __atomic_load_n(&callee->hotFunction, __ATOMIC_ACQUIRE);
+            bool selfCall = (callee == _function) && (_osrBytecodeIndex < 0);
+            if (!selfCall && (nullptr != entry) && (_directCallees.end() == _directCallees.find(callee))) {
+                std::string &calleeName = _directCallees[callee];
+                calleeName = std::string("compiled_") + callee->functionName;
+                DefineFunction((char *)calleeName.c_str(),
+                              (char *)__FILE__,
+                              (char *)LINETOSTR(__LINE__),
+                              entry,
+                              Int64,
+                              2,
+                              pVMType,
+                              types->pInt64);
+            }
+        }
+        index += Bytecode::getBytecodeLength(opcode);
+    }
+}
+
+/* Replaces the shared CALL handler. The callee is known when the method is
+ * built, so instead of indexing vm->functions and testing compiledFunction on
+ * every call this emits one of:
+ *  - a recursive call to this method
+ *  - a direct call to the callee's compiled body
+ *  - a call through the callee's compiledFunction cell, which the compile
+ *    queue fills in once the callee is compiled, falling back to the
+ *    interpreter until then
+ */
+int64_t CMInterpreterMethod::doCall(RuntimeBuilder *rb, IlBuilder *b) {
+    CMInterpreterMethod *method = (CMInterpreterMethod *)rb;
+    int8_t *bytecode = method->_function->opcodes + ((BytecodeBuilder *)b)->bcIndex();
+    Function *callee = method->_vm->functions[*(int64_t *)(bytecode + IMMEDIATE0)];
+    int64_t argCount = *(int64_t *)(bytecode + IMMEDIATE1);
+
+    InterpreterVMState *state = (InterpreterVMState *)rb->GetVMState(b);
+    state->Commit(b);
+    b->Store("newArgs",
+    b->     Sub(
+               state->_stackTop->Load(b),
+    b->        ConstInt64(argCount * sizeof(int64_t))));
+
+    if (method->canInline(callee)) {
+        std::vector<IlValue *> args(argCount);
+        for (int64_t i = argCount - 1; i >= 0; i--) {
+            args[i] = pop(rb, b);
+        }
+        push(rb, b, method->inlineCall(b, callee, args));
+        rb->DefaultFallthrough(b, b->ConstInt64(17));
+        return 0;
+    }
+
+    std::map<Function *, std::string>::iterator direct = method->_directCallees.find(callee);
+    if ((callee == method->_function) && (method->_osrBytecodeIndex < 0)) {
+        b->Store("call_retVal",
+        b->     Call(method->_name.c_str(), 2, b->Load("vm"), b->Load("newArgs")));
+    } else if (method->_directCallees.end() != direct) {
+        b->Store("call_retVal",
+        b->     Call(direct->second.c_str(), 2, b->Load("vm"), b->Load("newArgs")));
+    } else {
+        b->Store("compiledFunction",
+        b->     LoadIndirect("Function", "compiledFunction",
+        b->                 ConstAddress(callee)));
+
+        IlBuilder *callJit = nullptr;
+        IlBuilder *callInterpreter = nullptr;
+        b->IfThenElse(&callInterpreter, &callJit,
+        b->          EqualTo(
+        b->                 Load("compiledFunction"),
+        b->                 NullAddress()));
+
+        callJit->Store("call_retVal",
+        callJit->     ComputedCall("invokeCompiledFunction", 3, callJit->Load("compiledFunction"), callJit->Load("vm"), callJit->Load("newArgs")));
+
+        callInterpreter->Store("call_retVal",
+        callInterpreter->     Call("callInterpretedFunction", 3, callInterpreter->Load("vm"), callInterpreter->ConstAddress(callee), callInterpreter->Load("newArgs")));
+    }
+
+    state->_stack->Drop(b, b->ConstInt64(argCount));
+
+    push(rb, b, b->Load("call_retVal"));
+    rb->DefaultFallthrough(b, b->ConstInt64(17));
+    return 0;
+}
+
+const char *CMInterpreterMethod::inlineName(int64_t inlineID, const char *kind, int64_t index) {
+    _inlineNames.push_back("inl" + std::to_string(inlineID) + "_" + kind + std::to_string(index));
+    return _inlineNames.back().c_str();
+}
+
+bool CMInterpreterMethod::canInline(Function *callee) {
+    if (JIT_LEVEL_HOT != _level) {
+        return false;
+    }
+    if ((int64_t)_inlineStack.size() >= _vm->tieringPolicy->inlineDepth()) {
+        return false;
+    }
+    if ((callee->opcodeCount > INLINE_MAX_CALLEE_SIZE) || (_inlinedSize + callee->opcodeCount > INLINE_MAX_GROWTH)) {
+        return false;
+    }
+    if (callee == _function) {
+        return false;
+    }
+    if (!ensureFunctionLoaded(_vm, callee)) {
+        return false;
+    }
+    for (size_t i = 0; i < _inlineStack.size(); i++) {
+        if (callee == _inlineStack[i]) {
+            return false;
+        }
+    }
+    std::vector<int64_t> depths;
+    return computeStackDepths(callee, depths);
+}
+
+/* Walks every path through the callee and records the operand stack depth on
+ * entry to each bytecode. The callee's stack slots become IL locals, which only
+ * works if each bytecode is always reached with the same depth.
+ */
+bool CMInterpreterMethod::computeStackDepths(Function *callee, std::vector<int64_t> &depths) {
+    int8_t *opcodes = callee->opcodes;
+    std::vector<bool> boundaries(callee->opcodeCount, false);
+    for (int64_t index = 0; index < callee->opcodeCount; index += Bytecode::getBytecodeLength((Bytecodes)opcodes[index])) {
+        boundaries[index] = true;
+    }
+    depths.assign(callee->opcodeCount, -1);
+    std::vector<int64_t> worklist;
+    depths[0] = 0;
+    worklist.push_back(0);
+    while (!worklist.empty()) {
+        int64_t index = worklist.back();
+        worklist.pop_back();
+        int64_t depth = depths[index];
+        Bytecodes opcode = (Bytecodes)opcodes[index];
+        int64_t next = index + Bytecode::getBytecodeLength(opcode);
+        int64_t target = -1;
+        bool fallsThrough = true;
+
+        /* operands have to be on the stack before the result is pushed, or
+         * ADD on a single value would load slot -1 */
+        int64_t pops = 0;
+        int64_t pushes = 0;
+        switch (opcode) {
+        case Bytecodes::NOP:
+            break;
+        case Bytecodes::PUSH_CONSTANT:
+        case Bytecodes::PUSH_ARG:
+        case Bytecodes::PUSH_LOCAL:
+        case Bytecodes::CURRENT_TIME:
+            pushes = 1;
+            break;
+        case Bytecodes::DUP:
+            pops = 1;
+            pushes = 2;
+            break;
+        case Bytecodes::POP:
+        case Bytecodes::POP_LOCAL:
+        case Bytecodes::PRINT_INT64:
+            pops = 1;
+            break;
+        case Bytecodes::ADD:
+        case Bytecodes::SUB:
+        case Bytecodes::MUL:
+        case Bytecodes::DIV:
+        case Bytecodes::MOD:
+            pops = 2;
+            pushes = 1;
+            break;
+        case Bytecodes::PRINT_STRING:
+            break;
+        case Bytecodes::JMP:
+            target = *(int64_t *)(opcodes + index + IMMEDIATE0);
+            fallsThrough = false;
+            break;
+        case Bytecodes::JMPE:
+        case Bytecodes::JMPL:
+        case Bytecodes::JMPG:
+            pops = 2;
+            target = *(int64_t *)(opcodes + index + IMMEDIATE0);
+            break;
+        case Bytecodes::CALL:
+            pops = *(int64_t *)(opcodes + index + IMMEDIATE1);
+            pushes = 1;
+            break;
+        case Bytecodes::RET:
+            pops = 1;
+            fallsThrough = false;
+            break;
+        default:
+            /* HALT and anything unknown keep the callee out of line */
+            return false;
+        }
+
+        if ((pops < 0) || (depth < pops)) {
+            return false;
+        }
+        depth += pushes - pops;
+        if ((depth < 0) || (depth > callee->maxStackDepth)) {
+            return false;
+        }
+        if ((Bytecodes::PUSH_ARG == opcode) && (*(int64_t *)(opcodes + index + IMMEDIATE0) >= callee->argCount)) {
+            return false;
+        }
+        if (((Bytecodes::PUSH_LOCAL == opcode) || (Bytecodes::POP_LOCAL == opcode))
+            && (*(int64_t *)(opcodes + index + IMMEDIATE0) >= callee->localCount)) {
+            return false;
+        }
+        int64_t successors[2] = { fallsThrough ? next : -1, target };
+        for (int32_t i = 0; i < 2; i++) {
+            int64_t successor = successors[i];
+            if (-1 == successor) {
+                continue;
+            }
+            if ((successor < 0) || (successor >= callee->opcodeCount) || !boundaries[successor]) {
+                return false;
+            }
+            if (-1 == depths[successor]) {
+                depths[successor] = depth;
+                worklist.push_back(successor);
+            } else if (depth != depths[successor]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Translates the callee's bytecode straight into the caller's IL. Args, locals
+ * and operand stack slots of the callee become IL locals named after the
+ * inline instance, each reachable bytecode gets its own block and RET stores
+ * the result and leaves through a shared exit block.
+ */
+IlValue *CMInterpreterMethod::inlineCall(IlBuilder *b, Function *callee, std::vector<IlValue *> &args) {
+    std::vector<int64_t> depths;
+    computeStackDepths(callee, depths);
+
+    int64_t inlineID = _inlineCount++;
+    _inlinedSize += callee->opcodeCount;
+    _inlineStack.push_back(callee);
+
+    for (int64_t i = 0; i < callee->argCount; i++) {
+        b->Store(inlineName(inlineID, "arg", i), args[i]);
+    }
+    for (int64_t i = 0; i < callee->localCount; i++) {
+        b->Store(inlineName(inlineID, "local", i), b->ConstInt64(0));
+    }
+    /* blocks are appended in bytecode order, so a block reached only by a
+     * backward jump would load slots no earlier block stored */
+    for (int64_t i = 0; i < callee->maxStackDepth; i++) {
+        b->Store(inlineName(inlineID, "s", i), b->ConstInt64(0));
+    }
+    b->Store(inlineName(inlineID, "ret", 0), b->ConstInt64(0));
+
+    std::vector<IlBuilder *> blocks(callee->opcodeCount, nullptr);
+    for (int64_t index = 0; index < callee->opcodeCount; index++) {
+        if (-1 != depths[index]) {
+            blocks[index] = OrphanBuilder();
+        }
+    }
+    IlBuilder *exit = OrphanBuilder();
+
+    for (int64_t index = 0; index < callee->opcodeCount; index++) {
+        if (nullptr != blocks[index]) {
+            b->AppendBuilder(blocks[index]);
+            inlineBytecode(blocks[index], callee, index, depths[index], inlineID, blocks, exit);
+        }
+    }
+    b->AppendBuilder(exit);
+
+    _inlineStack.pop_back();
+    return exit->Load(inlineName(inlineID, "ret", 0));
+}
+
+void CMInterpreterMethod::inlineBytecode(IlBuilder *b, Function *callee, int64_t index, int64_t depth, int64_t inlineID,
+                                         std::vector<IlBuilder *> &blocks, IlBuilder *exit) {
+    int8_t *bytecode = callee->opcodes + index;
+    Bytecodes opcode = (Bytecodes)*bytecode;
+    int64_t immediate = 0;
+    if (Bytecode::getBytecodeLength(opcode) > 1) {
+        immediate = *(int64_t *)(bytecode + IMMEDIATE0);
+    }
+    IlBuilder *next = nullptr;
+    if (index + Bytecode::getBytecodeLength(opcode) < callee->opcodeCount) {
+        next = blocks[index + Bytecode::getBytecodeLength(opcode)];
+    }
+
+    switch (opcode) {
+    case Bytecodes::NOP:
+        break;
+    case Bytecodes::PUSH_CONSTANT:
+        b->Store(inlineName(inlineID, "s", depth), b->ConstInt64(immediate));
+        break;
+    case Bytecodes::PUSH_ARG:
+        b->Store(inlineName(inlineID, "s", depth), b->Load(inlineName(inlineID, "arg", immediate)));
+        break;
+    case Bytecodes::PUSH_LOCAL:
+        b->Store(inlineName(inlineID, "s", depth), b->Load(inlineName(inlineID, "local", immediate)));
+        break;
+    case Bytecodes::POP:
+        break;
+    case Bytecodes::POP_LOCAL:
+        b->Store(inlineName(inlineID, "local", immediate), b->Load(inlineName(inlineID, "s", depth - 1)));
+        break;
+    case Bytecodes::DUP:
+        b->Store(inlineName(inlineID, "s", depth), b->Load(inlineName(inlineID, "s", depth - 1)));
+        break;
+    case Bytecodes::ADD:
+    case Bytecodes::SUB:
+    case Bytecodes::MUL:
+    case Bytecodes::DIV:
+    case Bytecodes::MOD:
+    {
+        IlValue *left = b->Load(inlineName(inlineID, "s", depth - 2));
+        IlValue *right = b->Load(inlineName(inlineID, "s", depth - 1));
+        IlValue *result = nullptr;
+        if (Bytecodes::ADD == opcode) {
+            result = b->Add(left, right);
+        } else if (Bytecodes::SUB == opcode) {
+            result = b->Sub(left, right);
+        } else if (Bytecodes::MUL == opcode) {
+            result = b->Mul(left, right);
+        } else if (Bytecodes::DIV == opcode) {
+            result = b->Div(left, right);
+        } else {
+            result = b->Rem(left, right);
+        }
+        b->Store(inlineName(inlineID, "s", depth - 2), result);
+        break;
+    }
+    case Bytecodes::JMP:
+        b->Goto(blocks[immediate]);
+        return;
+    case Bytecodes::JMPE:
+    case Bytecodes::JMPL:
+    case Bytecodes::JMPG:
+    {
+        IlValue *left = b->Load(inlineName(inlineID, "s", depth - 2));
+        IlValue *right = b->Load(inlineName(inlineID, "s", depth - 1));
+        if (Bytecodes::JMPE == opcode) {
+            b->IfCmpEqual(blocks[immediate], left, right);
+        } else if (Bytecodes::JMPL == opcode) {
+            b->IfCmpLessThan(blocks[immediate], left, right);
+        } else {
+            b->IfCmpGreaterThan(blocks[immediate], left, right);
+        }
+        break;
+    }
+    case Bytecodes::CALL:
+    {
+        Function *target = _vm->functions[immediate];
+        int64_t argCount = *(int64_t *)(bytecode + IMMEDIATE1);
+        int64_t base = depth - argCount;
+        IlValue *result = nullptr;
+        if (canInline(target)) {
+            std::vector<IlValue *> args(argCount);
+            for (int64_t i = 0; i < argCount; i++) {
+                args[i] = b->Load(inlineName(inlineID, "s", base + i));
+            }
+            result = inlineCall(b, target, args);
+        } else {
+            const char *callArgs = inlineName(inlineID, "callargs", index);
+            b->Store(callArgs, b->CreateLocalArray(argCount > 0 ? argCount : 1, Int64));
+            for (int64_t i = 0; i < argCount; i++) {
+                b->StoreAt(
+                    b->IndexAt(typeDictionary()->pInt64, b->Load(callArgs), b->ConstInt64(i)),
+                    b->Load(inlineName(inlineID, "s", base + i)));
+            }
+            result = b->Call("callInterpretedFunction", 3, b->Load("vm"), b->ConstAddress(target), b->Load(callArgs));
+        }
+        b->Store(inlineName(inlineID, "s", base), result);
+        break;
+    }
+    case Bytecodes::RET:
+        b->Store(inlineName(inlineID, "ret", 0), b->Load(inlineName(inlineID, "s", depth - 1)));
+        b->Goto(exit);
+        return;
+    case Bytecodes::PRINT_STRING:
+    {
+        String *string = _vm->strings[immediate];
+        b->Call("printStringHelper", 2, b->ConstInt64((int64_t)string->data), b->ConstInt64(string->length));
+        break;
+    }
+    case Bytecodes::PRINT_INT64:
+        b->Call("printInt64", 1, b->Load(inlineName(inlineID, "s", depth - 1)));
+        break;
+    case Bytecodes::CURRENT_TIME:
+        b->Store(inlineName(inlineID, "s", depth), b->Call("getCurrentTime", 0));
+        break;
+    default:
+        break;
+    }
+
+    /* computeStackDepths rejects callees that can run off the end without a RET */
+    b->Goto(next);
 }
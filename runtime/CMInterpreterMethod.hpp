@@ -24,21 +24,57 @@
 #ifndef CM_INTERPRETERMETHOD_INCL
 #define CM_INTERPRETERMETHOD_INCL
 
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
 #include "EL.hpp"
 #include "JitBuilder.hpp"
 #include "CompiledMethodBuilder.hpp"
 
 typedef int64_t (CMInterpreterMethodType)(VM *vm, int64_t *a);
+typedef int64_t (CMInterpreterOSRMethodType)(VM *vm, int64_t *a, int64_t *osrLocals);
 
 class CMInterpreterMethod : public OMR::JitBuilder::CompiledMethodBuilder
     {
 public:
-    CMInterpreterMethod(OMR::JitBuilder::TypeDictionary *, VM *vm, Function *function);
+    CMInterpreterMethod(OMR::JitBuilder::TypeDictionary *, VM *vm, Function *function, int64_t osrBytecodeIndex = -1, int64_t level = JIT_LEVEL_HOT);
 
     virtual void Setup();
 
 private:
+    void defineDirectCallees();
+    void *handler(Bytecodes opcode);
+    static int64_t doOSREntry(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::IlBuilder *b);
+    static int64_t doCall(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::IlBuilder *b);
+    static int64_t doCountedJMP(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::IlBuilder *b);
+    static int64_t doCountedJMPE(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::IlBuilder *b);
+    static int64_t doCountedJMPL(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::IlBuilder *b);
+    static int64_t doCountedJMPG(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::IlBuilder *b);
+    void countBackEdge(OMR::JitBuilder::IlBuilder *b);
+    void countTowardsRecompile(OMR::JitBuilder::IlBuilder *b, const char *counter, int64_t threshold);
+
+    bool canInline(Function *callee);
+    bool computeStackDepths(Function *callee, std::vector<int64_t> &depths);
+    OMR::JitBuilder::IlValue *inlineCall(OMR::JitBuilder::IlBuilder *b, Function *callee, std::vector<OMR::JitBuilder::IlValue *> &args);
+    void inlineBytecode(OMR::JitBuilder::IlBuilder *b, Function *callee, int64_t index, int64_t depth, int64_t inlineID,
+                        std::vector<OMR::JitBuilder::IlBuilder *> &blocks, OMR::JitBuilder::IlBuilder *exit);
+    const char *inlineName(int64_t inlineID, const char *kind, int64_t index);
+
+    VM *_vm;
     Function *_function;
+    int64_t _osrBytecodeIndex;
+    int64_t _level;
+    std::string _name;
+    /* callees that were already compiled when this method was built, keyed to their DefineFunction name */
+    std::map<Function *, std::string> _directCallees;
+    /* functions currently being inlined, innermost last */
+    std::vector<Function *> _inlineStack;
+    int64_t _inlinedSize;
+    int64_t _inlineCount;
+    /* JitBuilder keeps the symbol names it is given so they have to outlive the compile */
+    std::deque<std::string> _inlineNames;
     };
 
 #endif // !defined(CM_INTERPRETERMETHOD_INCL)
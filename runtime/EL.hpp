@@ -37,29 +37,82 @@
 /* CInterpreter specific defines */
 #define INTERP_FORCE_REGISTERS 1
 #define INTERP_USE_COMPUTED_GOTO 1
+/* keep the top of the operand stack in a register instead of memory, off since
+ * flushing it on every CALL costs call heavy programs more than loops gain */
+#define INTERP_CACHE_TOS 0
+/* fuse common bytecode sequences into single threaded code dispatches */
+#define INTERP_USE_SUPERINSTRUCTIONS 1
+/* count executed opcode pairs so -recordpairs can write a profile, disables fusion */
+#define INTERP_RECORD_PAIRS 0
+/* count taken and not taken conditional jumps for -writeprofile, disables fusion */
+#define INTERP_PROFILE_BRANCHES 0
 
 /* JitBuilder specific defines */
 #define USE_COMPUTED_GOTO 1
 
 #define FRAME_INLINED_DATA_LENGTH 8
+#define VM_STACK_SLOTS (1024 * 1024)
+/* TieringPolicy defaults, see -tiering to change them without a rebuild */
+#define INVOCATIONS_BEFORE_BASELINE 2
 #define INVOCATIONS_BEFORE_COMPILE 10
-//#define INVOCATIONS_BEFORE_COMPILE 200000000
+#define INVOCATIONS_BEFORE_RECOMPILE 1000
+#define BACKEDGES_BEFORE_RECOMPILE 100000
+#define BACKEDGES_BEFORE_OSR 1000
+#define INLINE_MAX_CALLEE_SIZE 128
+/* hot bodies only inline with -tiering inline=<depth> */
+#define INLINE_DEPTH 0
+#define INLINE_MAX_GROWTH 1024
+#define BASELINE_CODE_CHUNK_SIZE (1024 * 1024)
+
+/* a pair has to be at least 1/SUPERINSTRUCTION_PAIR_SHARE of a recorded profile for its superinstructions to be used */
+#define SUPERINSTRUCTION_PAIR_SHARE 1000
+#define SUPERINSTRUCTIONS_ALL (~(uint64_t)0)
 
 #define IMMEDIATE0 1
 #define IMMEDIATE1 9
 
+/* Function::compileState and Function::osrCompileState */
+#define COMPILE_NOT_STARTED 0
+#define COMPILE_QUEUED 1
+#define COMPILE_SUCCEEDED 2
+#define COMPILE_FAILED 3
+
+/* CMInterpreterMethod levels, warm bodies skip inlining and count towards a hot recompile */
+#define JIT_LEVEL_WARM 1
+#define JIT_LEVEL_HOT 2
+
+class CompileQueue;
+class TieringPolicy;
+
 typedef struct Function {
     char *functionName;
     int64_t functionID;
     int64_t invokedCount;
+    int64_t baselineThreshold; /* invokedCount that triggers a baseline compile, 0 for never */
+    int64_t compileThreshold; /* invokedCount that triggers a JIT compile, counting stops there, 0 for never */
+    int64_t osrThreshold; /* loop header executions before an OSR compile */
     void *compiledFunction;
+    void *osrFunction;
+    int64_t osrBytecodeIndex;
+    int64_t compileState;
+    int64_t osrCompileState;
+    int64_t recompileState; /* the hot recompile of a warm body */
+    void *hotFunction; /* body compiled at JIT_LEVEL_HOT, published once and never replaced */
+    int64_t compiledInvokedCount; /* counted by warm bodies */
+    int64_t compiledBackEdgeCount; /* counted by warm bodies */
     int64_t maxStackDepth;
     int64_t argCount;
     int64_t localCount;
     int64_t opcodeCount;
     int8_t *opcodes;
+    void *threadedCode;
+    void *registerCode; /* RegisterInterpreter's translation */
+    int64_t baselineState; /* BaselineCompiler's compile state, only used on the interpreter thread */
 } Function;
 
+/* loads and verifies the body of a function that was only listed in the function directory */
+typedef bool (FunctionLoaderType)(void *loader, Function *function);
+
 typedef struct Frame {
     Frame *previous;
     Function *function;
@@ -76,18 +129,32 @@ typedef struct String {
 
 typedef struct VM {
     Function **functions;
+    int64_t functionCount;
     String **strings;
     Frame *frame;
     void *interpretFunction;
     int64_t verbose;
+    int64_t jitEnabled;
+    int64_t baselineEnabled;
+    int64_t *stackBase;
+    int64_t *stackTop;
+    int64_t *stackLimit;
+    CompileQueue *compileQueue;
+    TieringPolicy *tieringPolicy;
+    void *functionLoader;
+    FunctionLoaderType *loadFunction;
+    uint64_t superinstructions; /* bit per CInterpreter superinstruction table entry */
 } VM;
 
 typedef struct Program {
     char *programName;
+    int64_t formatVersion;
     int64_t functionCount;
     Function **functions;
     int64_t stringCount;
     String **strings;
+    void *functionLoader;
+    FunctionLoaderType *loadFunction;
 } Program;
 
 #endif /* EL_INCL */
@@ -0,0 +1,213 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cstring>
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "EL.hpp"
+#include "Bytecodes.hpp"
+#include "Helpers.hpp"
+#include "CInterpreter.hpp"
+#include "TieringPolicy.hpp"
+#include "ExecutionProfile.hpp"
+
+typedef struct HotFunction {
+    Function *function;
+    FunctionProfile *counts;
+} HotFunction;
+
+ExecutionProfile::ExecutionProfile()
+    : _compiledCount(0)
+{}
+
+#if INTERP_PROFILE_BRANCHES
+static bool isConditionalJump(Bytecodes opcode) {
+    return (Bytecodes::JMPE == opcode) || (Bytecodes::JMPL == opcode) || (Bytecodes::JMPG == opcode);
+}
+#endif
+
+/* Invocations are the interpreter's count up to the compile threshold plus what
+ * a warm body counted after it, back edges are the loop header counters of the
+ * threaded code plus what a warm body counted. Everything else runs uncounted,
+ * so both are lower bounds.
+ */
+static void countFunction(Function *function, FunctionProfile *counts) {
+    counts->invocations = function->invokedCount + function->compiledInvokedCount;
+    counts->backEdges = function->compiledBackEdgeCount;
+    counts->loopBytecodeIndex = -1;
+    counts->loopBackEdges = 0;
+
+    int64_t osrCompileState = __atomic_load_n(&function->osrCompileState, __ATOMIC_ACQUIRE);
+    bool osrRequested = (COMPILE_QUEUED == osrCompileState) || (COMPILE_SUCCEEDED == osrCompileState);
+    ThreadedInstruction *slot = (ThreadedInstruction *)function->threadedCode;
+    int64_t index = 0;
+    while ((nullptr != slot) && (index < function->opcodeCount)) {
+        int64_t headerCount = (slot->counter > 0) ? slot->counter : 0;
+        /* the counter of the OSR loop starts over while its body compiles, it got to the threshold at least once */
+        if (osrRequested && (index == function->osrBytecodeIndex) && (headerCount < function->osrThreshold)) {
+            headerCount = function->osrThreshold;
+        }
+        counts->backEdges += headerCount;
+        if (headerCount > counts->loopBackEdges) {
+            counts->loopBytecodeIndex = index;
+            counts->loopBackEdges = headerCount;
+        }
+        index += Bytecode::getBytecodeLength((Bytecodes)function->opcodes[index]);
+        slot += 1;
+    }
+}
+
+#if INTERP_PROFILE_BRANCHES
+static void writeBranches(FILE *profile, Function *function) {
+    ThreadedInstruction *slot = (ThreadedInstruction *)function->threadedCode;
+    int64_t index = 0;
+    while ((nullptr != slot) && (index < function->opcodeCount)) {
+        Bytecodes opcode = (Bytecodes)function->opcodes[index];
+        if (isConditionalJump(opcode) && (0 != slot->taken + slot->notTaken)) {
+            fprintf(profile, "branch %s %" PRId64 " %" PRId64 " %" PRId64 " %.4f\n", function->functionName, index,
+                    slot->taken, slot->notTaken, (double)slot->taken / (double)(slot->taken + slot->notTaken));
+        }
+        index += Bytecode::getBytecodeLength(opcode);
+        slot += 1;
+    }
+}
+#endif
+
+/* Each function that ran is a line
+ * "function <name> <invocations> <back edges> <hottest loop bytecode index> <its back edges>",
+ * builds with INTERP_PROFILE_BRANCHES add a line
+ * "branch <name> <bytecode index> <taken> <not taken> <taken ratio>" per conditional jump that ran.
+ * Call it once the compile threads are stopped.
+ */
+bool ExecutionProfile::write(VM *vm, const char *profileFileName) {
+    FILE *profile = fopen(profileFileName, "w");
+    if (NULL == profile) {
+        fprintf(stderr, "Error opening execution profile %s\n", profileFileName);
+        return false;
+    }
+    for (int64_t i = 0; i < vm->functionCount; i++) {
+        Function *function = vm->functions[i];
+        if (nullptr == __atomic_load_n(&function->opcodes, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        FunctionProfile counts;
+        countFunction(function, &counts);
+        if ((0 == counts.invocations) && (0 == counts.backEdges)) {
+            continue;
+        }
+        fprintf(profile, "function %s %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 "\n", function->functionName,
+                counts.invocations, counts.backEdges, counts.loopBytecodeIndex, counts.loopBackEdges);
+#if INTERP_PROFILE_BRANCHES
+        writeBranches(profile, function);
+#endif
+    }
+    bool written = (0 == ferror(profile));
+    if ((0 != fclose(profile)) || !written) {
+        fprintf(stderr, "Error writing execution profile %s\n", profileFileName);
+        return false;
+    }
+    return true;
+}
+
+bool ExecutionProfile::read(const char *profileFileName) {
+    _profileFileName = profileFileName;
+    FILE *profile = fopen(profileFileName, "r");
+    if (NULL == profile) {
+        fprintf(stderr, "Error opening execution profile %s\n", profileFileName);
+        return false;
+    }
+    char kind[16];
+    char functionName[256];
+    while (2 == fscanf(profile, "%15s %255s", kind, functionName)) {
+        if (0 == strcmp("function", kind)) {
+            FunctionProfile counts;
+            if (4 != fscanf(profile, "%" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64,
+                            &counts.invocations, &counts.backEdges, &counts.loopBytecodeIndex, &counts.loopBackEdges)) {
+                fprintf(stderr, "Malformed entry for %s in execution profile %s\n", functionName, profileFileName);
+                break;
+            }
+            _functions[functionName] = counts;
+        } else {
+            /* branch counts are only for reading, the JIT has no way to use them yet */
+            int c = 0;
+            while ((EOF != (c = fgetc(profile))) && ('\n' != c)) {}
+        }
+    }
+    fclose(profile);
+    return true;
+}
+
+/* Queues everything that earned a compile in the profiled run under the current
+ * tiering policy, hottest first. Has to run after the policy was applied and
+ * before the program starts.
+ */
+int64_t ExecutionProfile::compileHotFunctions(VM *vm) {
+    std::vector<HotFunction> hotFunctions;
+    for (int64_t i = 0; i < vm->functionCount; i++) {
+        Function *function = vm->functions[i];
+        std::map<std::string, FunctionProfile>::iterator found = _functions.find(function->functionName);
+        if (_functions.end() == found) {
+            continue;
+        }
+        FunctionProfile *counts = &found->second;
+        if (0 == function->compileThreshold) {
+            continue;
+        }
+        if ((counts->invocations >= function->compileThreshold) || (counts->loopBackEdges >= function->osrThreshold)) {
+            HotFunction hot = { function, counts };
+            hotFunctions.push_back(hot);
+        }
+    }
+    std::stable_sort(hotFunctions.begin(), hotFunctions.end(), [](const HotFunction &a, const HotFunction &b) {
+        return (a.counts->invocations + a.counts->backEdges) > (b.counts->invocations + b.counts->backEdges);
+    });
+
+    for (size_t i = 0; i < hotFunctions.size(); i++) {
+        Function *function = hotFunctions[i].function;
+        FunctionProfile *counts = hotFunctions[i].counts;
+        if (!ensureFunctionLoaded(vm, function)) {
+            continue;
+        }
+        if (counts->invocations >= function->compileThreshold) {
+            bool hot = (counts->invocations - function->compileThreshold >= vm->tieringPolicy->recompileInvocations())
+                       || (counts->backEdges >= vm->tieringPolicy->recompileBackEdges());
+            precompileFunction(vm, function, hot ? JIT_LEVEL_HOT : JIT_LEVEL_WARM);
+        }
+        if ((counts->loopBackEdges >= function->osrThreshold) && isLoopHeader(function, counts->loopBytecodeIndex)) {
+            compileOSRFunction(vm, function, counts->loopBytecodeIndex);
+        }
+        _compiledCount += 1;
+    }
+    return _compiledCount;
+}
+
+void ExecutionProfile::printStatistics(FILE *out) {
+    fprintf(out, "Execution profile %s: %zu functions profiled, %" PRId64 " compiled ahead\n",
+            _profileFileName.c_str(), _functions.size(), _compiledCount);
+}
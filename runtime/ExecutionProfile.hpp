@@ -0,0 +1,64 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "EL.hpp"
+
+#ifndef EXECUTIONPROFILE_INCL
+#define EXECUTIONPROFILE_INCL
+
+typedef struct FunctionProfile {
+    int64_t invocations;
+    int64_t backEdges;
+    int64_t loopBytecodeIndex; /* the loop header with the most back edges, -1 for none */
+    int64_t loopBackEdges;
+} FunctionProfile;
+
+/* What the engines counted in one run, written by -writeprofile at exit and
+ * read by -readprofile so the next run can queue the functions that were hot
+ * for compilation as soon as the program is loaded. Functions are matched by
+ * name, so a profile still applies after the program is rebuilt or moved to
+ * another machine, and functions that no longer exist are skipped. Branch
+ * counts are only written by builds with INTERP_PROFILE_BRANCHES.
+ */
+class ExecutionProfile {
+public:
+    ExecutionProfile();
+
+    static bool write(VM *vm, const char *profileFileName);
+    bool read(const char *profileFileName);
+    int64_t compileHotFunctions(VM *vm);
+    void printStatistics(FILE *out);
+
+private:
+    std::string _profileFileName;
+    std::map<std::string, FunctionProfile> _functions;
+    int64_t _compiledCount;
+};
+
+#endif /* EXECUTIONPROFILE_INCL */
@@ -59,7 +59,16 @@ void IBInterpreter::Setup()
     IfThenElse(&useDynamicData, &useStackData, GreaterThan(Load("dataLength"), ConstInt64(FRAME_INLINED_DATA_LENGTH)));
 
     useDynamicData->Store("localsSize", useDynamicData->Mul(useDynamicData->Load("localCount"), useDynamicData->ConstInt64(sizeof(int64_t))));
-    useDynamicData->Store("frameData", useDynamicData->Call("allocateFrameData", 3, useDynamicData->Load("function"), useDynamicData->Load("stackSize"), useDynamicData->Load("localsSize")));
+    useDynamicData->Store("frameData", useDynamicData->LoadIndirect("VM", "stackTop", useDynamicData->Load("vm")));
+    useDynamicData->Store("newStackTop", useDynamicData->Add(useDynamicData->Load("frameData"), useDynamicData->Add(useDynamicData->Load("stackSize"), useDynamicData->Load("localsSize"))));
+    IlBuilder *arenaExhausted = nullptr;
+    IlBuilder *arenaBump = nullptr;
+    useDynamicData->IfThenElse(&arenaExhausted, &arenaBump,
+    useDynamicData->          GreaterThan(
+    useDynamicData->                     ConvertTo(Int64, useDynamicData->Load("newStackTop")),
+    useDynamicData->                     ConvertTo(Int64, useDynamicData->LoadIndirect("VM", "stackLimit", useDynamicData->Load("vm")))));
+    arenaBump->StoreIndirect("VM", "stackTop", arenaBump->Load("vm"), arenaBump->Load("newStackTop"));
+    arenaExhausted->Store("frameData", arenaExhausted->Call("allocateFrameData", 4, arenaExhausted->Load("vm"), arenaExhausted->Load("function"), arenaExhausted->Load("stackSize"), arenaExhausted->Load("localsSize")));
     useDynamicData->Store("dataPointer", useDynamicData->Load("frameData"));
 
     useStackData->Store("frameData", useStackData->NullAddress());
@@ -117,28 +126,37 @@ IBInterpreter::IBInterpreter(TypeDictionary *types)
 }
 
 void IBInterpreter::registerHandlers(OMR::JitBuilder::RuntimeBuilder *rb) {
-    rb->RegisterHandler((int32_t)Bytecodes::NOP, Bytecode::getBytecodeName(Bytecodes::NOP), (void *)&doNop);
-    rb->RegisterHandler((int32_t)Bytecodes::PUSH_CONSTANT, Bytecode::getBytecodeName(Bytecodes::PUSH_CONSTANT), (void *)&doPushConstant);
-    rb->RegisterHandler((int32_t)Bytecodes::PUSH_ARG, Bytecode::getBytecodeName(Bytecodes::PUSH_ARG), (void *)&doPushArg);
-    rb->RegisterHandler((int32_t)Bytecodes::PUSH_LOCAL, Bytecode::getBytecodeName(Bytecodes::PUSH_LOCAL), (void *)&doPushLocal);
-    rb->RegisterHandler((int32_t)Bytecodes::POP, Bytecode::getBytecodeName(Bytecodes::POP), (void *)&doPop);
-    rb->RegisterHandler((int32_t)Bytecodes::POP_LOCAL, Bytecode::getBytecodeName(Bytecodes::POP_LOCAL), (void *)&doPopLocal);
-    rb->RegisterHandler((int32_t)Bytecodes::DUP, Bytecode::getBytecodeName(Bytecodes::DUP), (void *)&doDup);
-    rb->RegisterHandler((int32_t)Bytecodes::ADD, Bytecode::getBytecodeName(Bytecodes::ADD), (void *)&doAdd);
-    rb->RegisterHandler((int32_t)Bytecodes::SUB, Bytecode::getBytecodeName(Bytecodes::SUB), (void *)&doSub);
-    rb->RegisterHandler((int32_t)Bytecodes::MUL, Bytecode::getBytecodeName(Bytecodes::MUL), (void *)&doMul);
-    rb->RegisterHandler((int32_t)Bytecodes::DIV, Bytecode::getBytecodeName(Bytecodes::DIV), (void *)&doDiv);
-    rb->RegisterHandler((int32_t)Bytecodes::MOD, Bytecode::getBytecodeName(Bytecodes::MOD), (void *)&doMod);
-    rb->RegisterHandler((int32_t)Bytecodes::JMP, Bytecode::getBytecodeName(Bytecodes::JMP), (void *)&doJMP);
-    rb->RegisterHandler((int32_t)Bytecodes::JMPE, Bytecode::getBytecodeName(Bytecodes::JMPE), (void *)&doJMPE);
-    rb->RegisterHandler((int32_t)Bytecodes::JMPL, Bytecode::getBytecodeName(Bytecodes::JMPL), (void *)&doJMPL);
-    rb->RegisterHandler((int32_t)Bytecodes::JMPG, Bytecode::getBytecodeName(Bytecodes::JMPG), (void *)&doJMPG);
-    rb->RegisterHandler((int32_t)Bytecodes::CALL, Bytecode::getBytecodeName(Bytecodes::CALL), (void *)&doCall);
-    rb->RegisterHandler((int32_t)Bytecodes::RET, Bytecode::getBytecodeName(Bytecodes::RET), (void *)&doRet);
-    rb->RegisterHandler((int32_t)Bytecodes::PRINT_STRING, Bytecode::getBytecodeName(Bytecodes::PRINT_STRING), (void *)&doPrintString);
-    rb->RegisterHandler((int32_t)Bytecodes::PRINT_INT64, Bytecode::getBytecodeName(Bytecodes::PRINT_INT64), (void *)&doPrintInt64);
-    rb->RegisterHandler((int32_t)Bytecodes::CURRENT_TIME, Bytecode::getBytecodeName(Bytecodes::CURRENT_TIME), (void *)&doCurrentTime);
-    rb->RegisterHandler((int32_t)Bytecodes::HALT, Bytecode::getBytecodeName(Bytecodes::HALT), (void *)&doHalt);
+    for (int32_t opcode = 0; opcode < (int32_t)Bytecodes::ERROR; opcode++) {
+        rb->RegisterHandler(opcode, Bytecode::getBytecodeName((Bytecodes)opcode), handler((Bytecodes)opcode));
+    }
+}
+
+void *IBInterpreter::handler(Bytecodes opcode) {
+    switch (opcode) {
+        case Bytecodes::NOP: return (void *)&doNop;
+        case Bytecodes::PUSH_CONSTANT: return (void *)&doPushConstant;
+        case Bytecodes::PUSH_ARG: return (void *)&doPushArg;
+        case Bytecodes::PUSH_LOCAL: return (void *)&doPushLocal;
+        case Bytecodes::POP: return (void *)&doPop;
+        case Bytecodes::POP_LOCAL: return (void *)&doPopLocal;
+        case Bytecodes::DUP: return (void *)&doDup;
+        case Bytecodes::ADD: return (void *)&doAdd;
+        case Bytecodes::SUB: return (void *)&doSub;
+        case Bytecodes::MUL: return (void *)&doMul;
+        case Bytecodes::DIV: return (void *)&doDiv;
+        case Bytecodes::MOD: return (void *)&doMod;
+        case Bytecodes::JMP: return (void *)&doJMP;
+        case Bytecodes::JMPE: return (void *)&doJMPE;
+        case Bytecodes::JMPL: return (void *)&doJMPL;
+        case Bytecodes::JMPG: return (void *)&doJMPG;
+        case Bytecodes::CALL: return (void *)&doCall;
+        case Bytecodes::RET: return (void *)&doRet;
+        case Bytecodes::PRINT_STRING: return (void *)&doPrintString;
+        case Bytecodes::PRINT_INT64: return (void *)&doPrintInt64;
+        case Bytecodes::CURRENT_TIME: return (void *)&doCurrentTime;
+        case Bytecodes::HALT: return (void *)&doHalt;
+        default: return NULL;
+    }
 }
 
 void IBInterpreter::defineFunctions(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::TypeDictionary *types) {
@@ -188,10 +206,10 @@ void IBInterpreter::defineFunctions(OMR::JitBuilder::RuntimeBuilder *rb, OMR::Ji
                   pVMType,
                   types->pInt64);
 
-    rb->DefineFunction((char *)"compileFunction",
+    rb->DefineFunction((char *)"countFunctionInvocation",
                   (char *)__FILE__,
                   (char *)LINETOSTR(__LINE__),
-                  (void *)&compileFunction,
+                  (void *)&countFunctionInvocation,
                   types->NoType,
                   2,
                   pVMType,
@@ -202,7 +220,8 @@ void IBInterpreter::defineFunctions(OMR::JitBuilder::RuntimeBuilder *rb, OMR::Ji
                   (char *)LINETOSTR(__LINE__),
                   (void *)&allocateFrameData,
                   types->pInt64,
-                  3,
+                  4,
+                  pVMType,
                   pFunctionType,
                   types->Int64,
                   types->Int64);
@@ -212,7 +231,8 @@ void IBInterpreter::defineFunctions(OMR::JitBuilder::RuntimeBuilder *rb, OMR::Ji
                   (char *)LINETOSTR(__LINE__),
                   (void *)&freeFrameData,
                   types->NoType,
-                  1,
+                  2,
+                  pVMType,
                   types->pInt64);
 
     rb->DefineFunction((char *)"exit",
@@ -25,10 +25,12 @@
 #define IB_INTERPRETER_INCL
 
 #include "EL.hpp"
+#include "Bytecodes.hpp"
 #include "JitBuilder.hpp"
 #include "InterpreterBuilder.hpp"
 
 typedef int64_t (IBInterpreterType)(VM *vm, Function *function, int64_t *a);
+typedef int64_t (IBHandlerType)(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::IlBuilder *b);
 
 class IBInterpreter : public OMR::JitBuilder::InterpreterBuilder
     {
@@ -37,6 +39,7 @@ public:
 
     virtual void Setup();
     static void registerHandlers(OMR::JitBuilder::RuntimeBuilder *rb);
+    static void *handler(Bytecodes opcode);
     static void defineFunctions(OMR::JitBuilder::RuntimeBuilder *rb, OMR::JitBuilder::TypeDictionary *types);
 
     };
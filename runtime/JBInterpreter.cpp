@@ -106,7 +106,8 @@ JBInterpreter::JBInterpreter(OMR::JitBuilder::TypeDictionary *types) :
                    (char *)LINETOSTR(__LINE__),
                    (void *)&allocateFrameData,
                    _pInt64,
-                   3,
+                   4,
+                   pVMType,
                    pFunctionType,
                    Int64,
                    Int64);
@@ -116,7 +117,8 @@ JBInterpreter::JBInterpreter(OMR::JitBuilder::TypeDictionary *types) :
                    (char *)LINETOSTR(__LINE__),
                    (void *)&freeFrameData,
                    NoType,
-                   1,
+                   2,
+                   pVMType,
                    _pInt64);
 
     DefineFunction((char *)"InterpreterBuilder::handleBadOpcode",
@@ -236,7 +238,16 @@ bool JBInterpreter::buildIL() {
     IfThenElse(&useDynamicData, &useStackData, GreaterThan(Load("dataLength"), ConstInt64(FRAME_INLINED_DATA_LENGTH)));
 
     useDynamicData->Store("localsSize", useDynamicData->Mul(useDynamicData->Load("localCount"), useDynamicData->ConstInt64(sizeof(int64_t))));
-    useDynamicData->Store("data", useDynamicData->Call("allocateFrameData", 3, useDynamicData->Load("function"), useDynamicData->Load("stackSize"), useDynamicData->Load("localsSize")));
+    useDynamicData->Store("data", useDynamicData->LoadIndirect("VM", "stackTop", useDynamicData->Load("vm")));
+    useDynamicData->Store("newStackTop", useDynamicData->Add(useDynamicData->Load("data"), useDynamicData->Add(useDynamicData->Load("stackSize"), useDynamicData->Load("localsSize"))));
+    IlBuilder *arenaExhausted = nullptr;
+    IlBuilder *arenaBump = nullptr;
+    useDynamicData->IfThenElse(&arenaExhausted, &arenaBump,
+    useDynamicData->          GreaterThan(
+    useDynamicData->                     ConvertTo(Int64, useDynamicData->Load("newStackTop")),
+    useDynamicData->                     ConvertTo(Int64, useDynamicData->LoadIndirect("VM", "stackLimit", useDynamicData->Load("vm")))));
+    arenaBump->StoreIndirect("VM", "stackTop", arenaBump->Load("vm"), arenaBump->Load("newStackTop"));
+    arenaExhausted->Store("data", arenaExhausted->Call("allocateFrameData", 4, arenaExhausted->Load("vm"), arenaExhausted->Load("function"), arenaExhausted->Load("stackSize"), arenaExhausted->Load("localsSize")));
     useDynamicData->Store("dataPointer", useDynamicData->Load("data"));
 
     useStackData->Store("data", useStackData->NullAddress());
@@ -485,7 +496,7 @@ bool JBInterpreter::buildIL() {
         ret->                         Load("frame")));
         IlBuilder *freeData = nullptr;
         ret->IfThen(&freeData, ret->NotEqualTo(ret->Load("data"), ret->NullAddress()));
-        freeData->Call("freeFrameData", 1, freeData->Load("data"));
+        freeData->StoreIndirect("VM", "stackTop", freeData->Load("vm"), freeData->Load("data"));
         ret->Return(ret->Load("return_retVal"));
     }
 
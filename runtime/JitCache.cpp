@@ -0,0 +1,214 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cstring>
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "EL.hpp"
+#include "Helpers.hpp"
+#include "BaselineCompiler.hpp"
+#include "JitCache.hpp"
+
+/* tiers as written to the cache, warm and hot are the JIT_LEVEL_* values */
+#define JIT_CACHE_TIER_NONE -1
+#define JIT_CACHE_TIER_BASELINE 0
+
+static const char *tierNames[] = { "baseline", "warm", "hot" };
+
+typedef struct JitCacheEntry {
+    int64_t functionID;
+    std::string functionName;
+    uint64_t bytecodeHash;
+    int64_t tier;
+    int64_t osrBytecodeIndex;
+    int64_t invocations;
+} JitCacheEntry;
+
+JitCache::JitCache(const char *directory, const int8_t *image, int64_t imageSize, const std::string &options)
+    : _installedCount(0),
+    _staleCount(0)
+{
+    char cacheName[32];
+    snprintf(cacheName, sizeof(cacheName), "/%016" PRIx64 ".jit", hash(image, imageSize, 14695981039346656037ULL));
+    _fileName = std::string(directory) + cacheName;
+
+    int64_t compilerOptions[] = { JIT_CACHE_VERSION, INLINE_MAX_CALLEE_SIZE, INLINE_DEPTH, INLINE_MAX_GROWTH, (int64_t)sizeof(void *) };
+    _optionsHash = hash(options.data(), options.length(), 14695981039346656037ULL);
+    _optionsHash = hash(compilerOptions, sizeof(compilerOptions), _optionsHash);
+}
+
+/* FNV-1a, the same as the program cache in Main */
+uint64_t JitCache::hash(const void *data, int64_t length, uint64_t seed) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint64_t hash = seed;
+    for (int64_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t JitCache::hashFunction(Function *function) {
+    int64_t shape[] = { function->argCount, function->localCount, function->opcodeCount };
+    uint64_t functionHash = hash(shape, sizeof(shape), 14695981039346656037ULL);
+    return hash(function->opcodes, function->opcodeCount, functionHash);
+}
+
+static int64_t parseTier(const char *tierName) {
+    for (int64_t tier = JIT_CACHE_TIER_BASELINE; tier <= JIT_LEVEL_HOT; tier++) {
+        if (0 == strcmp(tierNames[tier], tierName)) {
+            return tier;
+        }
+    }
+    return JIT_CACHE_TIER_NONE;
+}
+
+static bool isRequested(int64_t state) {
+    return (COMPILE_QUEUED == state) || (COMPILE_SUCCEEDED == state);
+}
+
+/* a compile that was queued but dropped at shutdown still counts, the decision was made */
+static int64_t reachedTier(Function *function) {
+    if (isRequested(__atomic_load_n(&function->recompileState, __ATOMIC_ACQUIRE))) {
+        return JIT_LEVEL_HOT;
+    }
+    if (isRequested(__atomic_load_n(&function->compileState, __ATOMIC_ACQUIRE))) {
+        return JIT_LEVEL_WARM;
+    }
+    if (COMPILE_SUCCEEDED == function->baselineState) {
+        return JIT_CACHE_TIER_BASELINE;
+    }
+    return JIT_CACHE_TIER_NONE;
+}
+
+/* Each line after the header is
+ * "<function ID> <name> <bytecode hash> <tier|none> <OSR bytecode index> <invocations>".
+ * Has to run on the interpreter thread before the program starts, after the
+ * tiering policy was applied so functions it never compiles stay interpreted.
+ */
+int64_t JitCache::install(VM *vm) {
+    FILE *cache = fopen(_fileName.c_str(), "r");
+    if (NULL == cache) {
+        return 0;
+    }
+    int64_t version = 0;
+    uint64_t optionsHash = 0;
+    if ((2 != fscanf(cache, "eljit %" SCNd64 " %" SCNx64, &version, &optionsHash))
+        || (JIT_CACHE_VERSION != version) || (_optionsHash != optionsHash)) {
+        /* made with other options, it is replaced on exit */
+        fclose(cache);
+        return 0;
+    }
+
+    std::vector<JitCacheEntry> entries;
+    JitCacheEntry entry;
+    char functionName[256];
+    char tierName[16];
+    while (6 == fscanf(cache, "%" SCNd64 " %255s %" SCNx64 " %15s %" SCNd64 " %" SCNd64,
+                       &entry.functionID, functionName, &entry.bytecodeHash, tierName, &entry.osrBytecodeIndex, &entry.invocations)) {
+        entry.functionName = functionName;
+        entry.tier = parseTier(tierName);
+        entries.push_back(entry);
+    }
+    fclose(cache);
+
+    /* the hottest functions get to the front of the compile queue */
+    std::stable_sort(entries.begin(), entries.end(), [](const JitCacheEntry &a, const JitCacheEntry &b) {
+        return a.invocations > b.invocations;
+    });
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        JitCacheEntry *cached = &entries[i];
+        if ((cached->functionID < 0) || (cached->functionID >= vm->functionCount)) {
+            _staleCount += 1;
+            continue;
+        }
+        Function *function = vm->functions[cached->functionID];
+        if ((cached->functionName != function->functionName)
+            || !ensureFunctionLoaded(vm, function)
+            || (cached->bytecodeHash != hashFunction(function))) {
+            _staleCount += 1;
+            continue;
+        }
+        if (0 == function->compileThreshold) {
+            continue;
+        }
+        if (vm->baselineEnabled && (0 != function->baselineThreshold) && (JIT_CACHE_TIER_NONE != cached->tier)) {
+            compileBaselineFunction(vm, function);
+        }
+        if (vm->jitEnabled && (cached->tier >= JIT_LEVEL_WARM)) {
+            precompileFunction(vm, function, cached->tier);
+        }
+        if (vm->jitEnabled && (cached->osrBytecodeIndex >= 0) && isLoopHeader(function, cached->osrBytecodeIndex)) {
+            compileOSRFunction(vm, function, cached->osrBytecodeIndex);
+        }
+        _installedCount += 1;
+    }
+    return _installedCount;
+}
+
+/* Writes what this run decided. Call it once the compile threads are stopped. */
+bool JitCache::save(VM *vm) {
+    /* write then rename so concurrent runs never see a partial file */
+    std::string temporaryFile = _fileName + "." + std::to_string(getpid());
+    FILE *cache = fopen(temporaryFile.c_str(), "w");
+    if (NULL == cache) {
+        fprintf(stderr, "Warning: could not write the JIT cache %s\n", _fileName.c_str());
+        return false;
+    }
+    fprintf(cache, "eljit %d %016" PRIx64 "\n", JIT_CACHE_VERSION, _optionsHash);
+    for (int64_t i = 0; i < vm->functionCount; i++) {
+        Function *function = vm->functions[i];
+        if (nullptr == __atomic_load_n(&function->opcodes, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        int64_t tier = reachedTier(function);
+        int64_t osrBytecodeIndex = isRequested(__atomic_load_n(&function->osrCompileState, __ATOMIC_ACQUIRE)) ? function->osrBytecodeIndex : -1;
+        if ((JIT_CACHE_TIER_NONE == tier) && (osrBytecodeIndex < 0)) {
+            continue;
+        }
+        fprintf(cache, "%" PRId64 " %s %016" PRIx64 " %s %" PRId64 " %" PRId64 "\n",
+                i, function->functionName, hashFunction(function),
+                (JIT_CACHE_TIER_NONE == tier) ? "none" : tierNames[tier], osrBytecodeIndex,
+                function->invokedCount + function->compiledInvokedCount);
+    }
+    bool written = (0 == ferror(cache));
+    written = (0 == fclose(cache)) && written;
+    if (!written || (0 != rename(temporaryFile.c_str(), _fileName.c_str()))) {
+        fprintf(stderr, "Warning: could not write the JIT cache %s\n", _fileName.c_str());
+        unlink(temporaryFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+void JitCache::printStatistics(FILE *out) {
+    fprintf(out, "JIT cache %s: %" PRId64 " functions installed, %" PRId64 " stale entries\n",
+            _fileName.c_str(), _installedCount, _staleCount);
+}
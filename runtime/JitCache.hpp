@@ -0,0 +1,64 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "EL.hpp"
+
+#ifndef JITCACHE_INCL
+#define JITCACHE_INCL
+
+/* bump when the file layout or what the tiers compile changes */
+#define JIT_CACHE_VERSION 1
+
+/* Remembers across runs how far each function of a program got through the
+ * tiers, so the next run can install baseline code and queue its JIT compiles
+ * while the program loads instead of waiting for the counters. JitBuilder code
+ * is not relocatable, so the cache keeps the decisions and not the code. The
+ * file is named after the hash of the program image, its header holds the hash
+ * of everything that changes what the compilers produce, and every entry holds
+ * the hash of the bytecode it was made for, so a stale entry is just ignored.
+ */
+class JitCache {
+public:
+    JitCache(const char *directory, const int8_t *image, int64_t imageSize, const std::string &options);
+
+    int64_t install(VM *vm);
+    bool save(VM *vm);
+    void printStatistics(FILE *out);
+
+    static uint64_t hashFunction(Function *function);
+
+private:
+    static uint64_t hash(const void *data, int64_t length, uint64_t seed);
+
+    std::string _fileName;
+    uint64_t _optionsHash;
+    int64_t _installedCount;
+    int64_t _staleCount;
+};
+
+#endif /* JITCACHE_INCL */
@@ -2,29 +2,62 @@
 #include <fstream>
 #include <map>
 #include <string>
+#include <sstream>
+#include <chrono>
 
+#include <errno.h>
 #include <inttypes.h>
+#include <unistd.h>
 
 #include "EL.hpp"
 #include "ELParser.hpp"
 #include "CInterpreter.hpp"
+#include "RegisterInterpreter.hpp"
+#if defined(EL_TAILCALL_INTERPRETER)
+#include "TailCallInterpreter.hpp"
+#endif
 #include "IBInterpreter.hpp"
 #include "InterpreterTypeDictionary.hpp"
 #include "JBInterpreter.hpp"
 #include "Bytecodes.hpp"
 #include "Helpers.hpp"
+#include "CompileQueue.hpp"
+#include "TieringPolicy.hpp"
+#include "JitCache.hpp"
+#include "ExecutionProfile.hpp"
+#include "ELCompiler.hpp"
 
 typedef struct Options {
     const char *programFileName;
     bool dumpProgram;
     bool debugExecution;
     bool parseOnly;
+    bool jitEnabled;
+    bool jitRequested;
+    bool baselineEnabled;
+    bool jitStatistics;
+    bool useMmap;
+    bool loadStatistics;
+    const char *cacheDirectory;
+    const char *jitCacheDirectory;
+    const char *tieringSpec;
+    const char *pairProfileFileName;
+    const char *recordPairsFileName;
+    const char *writeProfileFileName;
+    const char *readProfileFileName;
+    bool useSuperinstructions;
+    int64_t compileThreads;
     int64_t interpreterType;
 } Options;
 
 using namespace std;
 
 void setDefaultOptions(Options *options);
+void startCompileQueue(VM *vm, Options *options);
+void stopCompileQueue(VM *vm, Options *options);
+bool isSourceFile(const char *fileName);
+bool compileSourceProgram(Options *options, std::string *cachedProgramFile, int8_t **image, int64_t *imageSize);
+std::string jitCacheOptions(Options *options);
 int64_t parseOptions(Options *options, int argc, char *argv[]);
 Function *findMainFunction(Program *program);
 void dumpProgram(Program *program);
@@ -36,25 +69,78 @@ int main(int argc, char *argv[]) {
     if (parseOptions(&options, argc, argv) != 0) {
         fprintf(stderr, "Usage:\n");
         fprintf(stderr, "\treader [options] programFile\n");
+        fprintf(stderr, "\tprogramFile is a compiled .le file, or a .el source file that is compiled in process\n");
         fprintf(stderr, "Options:\n");
-        fprintf(stderr, "\t-it<0,1,2>\tChoose the interpreter to use. default 0\n");
+        fprintf(stderr, "\t-it<0,1,2,3,4>\tChoose the interpreter to use, 3 runs a register form of the bytecode, 4 dispatches by tail calls when built with EL_TAILCALL_INTERPRETER. default 0\n");
         fprintf(stderr, "\t-o\tDump program after loading\n");
         fprintf(stderr, "\t-l\tOnly load the program but do not execute it\n");
         fprintf(stderr, "\t-t\tTrace the runtime execution\n");
+        fprintf(stderr, "\t-jit\tTier up hot functions to the baseline compiler and the JIT when using -it 0\n");
+        fprintf(stderr, "\t-nojit\tDo not compile hot functions when using -it 2\n");
+        fprintf(stderr, "\t-nobaseline\tDo not compile warm functions with the template baseline compiler when using -it 0 or -it 2\n");
+        fprintf(stderr, "\t-jitthreads <n>\tNumber of background compile threads, 0 compiles on the calling thread. default 1\n");
+        fprintf(stderr, "\t-jitstats\tPrint the tiering policy and compile queue statistics on exit\n");
+        fprintf(stderr, "\t-tiering <spec>\tOverride the tiering policy, also read from EL_TIERING. spec is a comma separated list of\n");
+        fprintf(stderr, "\t\tbaseline=<n>, compile=<n>, osr=<n>, recompile=<n>, recompilebackedges=<n>, decay=<calls>,\n");
+        fprintf(stderr, "\t\tsizeweight=<invocations per 100 bytes>, inline=<depth>, never=<name:name>, always=<name:name>\n");
+        fprintf(stderr, "\t-nommap\tRead the program file into memory instead of mapping it\n");
+        fprintf(stderr, "\t-loadstats\tPrint how long loading the program took\n");
+        fprintf(stderr, "\t-cache <dir>\tKeep programs compiled from .el sources in dir and reuse them while the source is unchanged\n");
+        fprintf(stderr, "\t-jitcache <dir>\tRemember in dir which functions were compiled and compile them while the next run of the same program loads, -it 0 with -jit only\n");
+        fprintf(stderr, "\t-nosuper\tDo not fuse bytecode sequences into superinstructions when using -it 0\n");
+        fprintf(stderr, "\t-superprofile <file>\tOnly use the superinstructions that are common in a recorded opcode pair profile\n");
+        fprintf(stderr, "\t-recordpairs <file>\tWrite the executed opcode pairs to file, needs a build with INTERP_RECORD_PAIRS\n");
+        fprintf(stderr, "\t-writeprofile <file>\tWrite per function invocation and back edge counts to file on exit, -it 0 only\n");
+        fprintf(stderr, "\t\tBuilds with INTERP_PROFILE_BRANCHES also write conditional branch counts\n");
+        fprintf(stderr, "\t-readprofile <file>\tCompile the functions that were hot in a profile written by -writeprofile as soon as the program is loaded, -it 0 with -jit only\n");
         return -1;
     }
 
-    ELParser parser(options.programFileName);
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+    const char *programFile = options.programFileName;
+    std::string cachedProgramFile;
+    int8_t *compiledImage = NULL;
+    int64_t compiledImageSize = 0;
+    if (isSourceFile(programFile)) {
+        if (!compileSourceProgram(&options, &cachedProgramFile, &compiledImage, &compiledImageSize)) {
+            return -1;
+        }
+        if (NULL == compiledImage) {
+            programFile = cachedProgramFile.c_str();
+        }
+    }
 
-    if (!parser.initialize()) {
+    ELParser parser(programFile, options.useMmap);
+
+    bool initialized = (NULL != compiledImage) ? parser.initialize(compiledImage, compiledImageSize) : parser.initialize();
+    if (!initialized) {
         return -1;
     }
 
+    /* keyed on the image before parsing touches it */
+    JitCache *jitCache = NULL;
+    if (NULL != options.jitCacheDirectory) {
+        jitCache = new JitCache(options.jitCacheDirectory, parser.image(), parser.imageSize(), jitCacheOptions(&options));
+    }
+
     Program *program = parser.parseProgram();
     if (NULL == program) {
         return -2;
     }
 
+    /* the C, register and tail call interpreters load functions lazily, everything else reads opcodes directly */
+    if (options.dumpProgram || options.parseOnly || ((options.interpreterType != 0) && (options.interpreterType != 3) && (options.interpreterType != 4))) {
+        if (!parser.loadAllFunctions()) {
+            return -2;
+        }
+    }
+
+    if (options.loadStatistics) {
+        int64_t loadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - loadStart).count();
+        fprintf(stderr, "Loaded program \"%s\" (format version %" PRId64 ", %" PRId64 " functions, %" PRId64 " strings) in %" PRId64 "us\n",
+                program->programName, program->formatVersion, program->functionCount, program->stringCount, loadTime);
+    }
+
     if (options.dumpProgram) {
         dumpProgram(program);
     }
@@ -67,15 +153,70 @@ int main(int argc, char *argv[]) {
     Function *main = findMainFunction(program);
     if (NULL != main) {
         VM vm;
+        TieringPolicy tieringPolicy;
+        const char *environmentTieringSpec = getenv("EL_TIERING");
+        if (((NULL != environmentTieringSpec) && !tieringPolicy.configure(environmentTieringSpec))
+            || ((NULL != options.tieringSpec) && !tieringPolicy.configure(options.tieringSpec))) {
+            return -1;
+        }
+        tieringPolicy.apply(program->functions, program->functionCount);
+        if (options.jitStatistics) {
+            tieringPolicy.printConfiguration(stderr);
+        }
+
         vm.functions = program->functions;
+        vm.functionCount = program->functionCount;
         vm.strings = program->strings;
         vm.interpretFunction = nullptr;
         vm.frame = nullptr;
         vm.verbose = 1;
+        /* -it 0 only tiers up when asked to with -jit */
+        vm.jitEnabled = options.jitEnabled && (options.jitRequested || (options.interpreterType != 0));
+        vm.baselineEnabled = vm.jitEnabled && options.baselineEnabled;
+        vm.compileQueue = nullptr;
+        vm.tieringPolicy = &tieringPolicy;
+        vm.functionLoader = program->functionLoader;
+        vm.loadFunction = program->loadFunction;
+        vm.superinstructions = options.useSuperinstructions ? SUPERINSTRUCTIONS_ALL : 0;
+        if (options.useSuperinstructions && (NULL != options.pairProfileFileName)) {
+            vm.superinstructions = selectSuperinstructions(options.pairProfileFileName);
+        }
+        allocateVMStack(&vm, VM_STACK_SLOTS);
         int64_t ret = -1;
         if (options.interpreterType == 0) {
+            vm.interpretFunction = (void *)&c_interpret;
+            ExecutionProfile profile;
+            if (vm.jitEnabled) {
+                initializeJit();
+                startCompileQueue(&vm, &options);
+                if (NULL != jitCache) {
+                    jitCache->install(&vm);
+                }
+                if ((NULL != options.readProfileFileName) && profile.read(options.readProfileFileName)) {
+                    profile.compileHotFunctions(&vm);
+                }
+            }
             CInterpreter interp;
             ret = interp.interpret(&vm, main, nullptr);
+            if (vm.jitEnabled) {
+                stopCompileQueue(&vm, &options);
+                if (NULL != jitCache) {
+                    jitCache->save(&vm);
+                    if (options.jitStatistics) {
+                        jitCache->printStatistics(stderr);
+                    }
+                }
+                if ((NULL != options.readProfileFileName) && options.jitStatistics) {
+                    profile.printStatistics(stderr);
+                }
+                shutdownJit();
+            }
+            if (NULL != options.writeProfileFileName) {
+                ExecutionProfile::write(&vm, options.writeProfileFileName);
+            }
+            if (NULL != options.recordPairsFileName) {
+                writePairProfile(options.recordPairsFileName);
+            }
         } else if(options.interpreterType == 1) {
             initializeJit();
             InterpreterTypeDictionary types;
@@ -98,19 +239,39 @@ int main(int argc, char *argv[]) {
             if (0 == rc) {
                 IBInterpreterType *ib_interpret = (IBInterpreterType *)entry;
                 vm.interpretFunction = (void *)ib_interpret;
+                startCompileQueue(&vm, &options);
                 ret = ib_interpret(&vm, main, nullptr);
+                stopCompileQueue(&vm, &options);
             } else {
                 fprintf(stderr, "Error generating IBInterpreter %d\n", rc);
             }
             shutdownJit();
+        } else if (options.interpreterType == 3) {
+            vm.interpretFunction = (void *)&r_interpret;
+            RegisterInterpreter interp;
+            ret = interp.interpret(&vm, main, nullptr);
+        } else if (options.interpreterType == 4) {
+#if defined(EL_TAILCALL_INTERPRETER)
+            /* interpreter only, this also keeps back edge handlers out of the shared threaded code */
+            vm.jitEnabled = false;
+            vm.baselineEnabled = false;
+            vm.interpretFunction = (void *)&t_interpret;
+            TailCallInterpreter interp;
+            ret = interp.interpret(&vm, main, nullptr);
+#else
+            fprintf(stderr, "Error interpreter type 4 needs a build with EL_TAILCALL_INTERPRETER\n");
+            return -3;
+#endif
         } else {
             fprintf(stderr, "Error unknown interpreter type %" PRIu64 "\n", options.interpreterType);
             return -3;
         }
         fprintf(stdout, "Main returned %" PRIu64 "\n", ret);
+        freeVMStack(&vm);
     } else {
         fprintf(stderr, "Failed to find main function\n");
     }
+    delete jitCache;
 
     return 0;
 }
@@ -133,6 +294,43 @@ int64_t parseOptions(Options *options, int argc, char *argv[]) {
                 fprintf(stderr, "Invalid option combination. -t and -l can not be used together\n");
                 return -1;
             }
+        } else if (0 == strcmp("-jit", arg)) {
+            options->jitRequested = true;
+        } else if (0 == strcmp("-nojit", arg)) {
+            options->jitEnabled = false;
+        } else if (0 == strcmp("-nobaseline", arg)) {
+            options->baselineEnabled = false;
+        } else if ((0 == strcmp("-jitthreads", arg)) && (i + 1 < argc - 1)) {
+            const char *threads = argv[++i];
+            char *end = NULL;
+            errno = 0;
+            options->compileThreads = strtoll(threads, &end, 10);
+            if (('\0' == *threads) || ('\0' != *end) || (0 != errno) || (options->compileThreads < 0)) {
+                fprintf(stderr, "-jitthreads needs a thread count of at least 0, not \"%s\"\n", threads);
+                return -1;
+            }
+        } else if (0 == strcmp("-jitstats", arg)) {
+            options->jitStatistics = true;
+        } else if ((0 == strcmp("-tiering", arg)) && (i + 1 < argc - 1)) {
+            options->tieringSpec = argv[++i];
+        } else if (0 == strcmp("-nommap", arg)) {
+            options->useMmap = false;
+        } else if (0 == strcmp("-loadstats", arg)) {
+            options->loadStatistics = true;
+        } else if ((0 == strcmp("-cache", arg)) && (i + 1 < argc - 1)) {
+            options->cacheDirectory = argv[++i];
+        } else if ((0 == strcmp("-jitcache", arg)) && (i + 1 < argc - 1)) {
+            options->jitCacheDirectory = argv[++i];
+        } else if (0 == strcmp("-nosuper", arg)) {
+            options->useSuperinstructions = false;
+        } else if ((0 == strcmp("-superprofile", arg)) && (i + 1 < argc - 1)) {
+            options->pairProfileFileName = argv[++i];
+        } else if ((0 == strcmp("-recordpairs", arg)) && (i + 1 < argc - 1)) {
+            options->recordPairsFileName = argv[++i];
+        } else if ((0 == strcmp("-writeprofile", arg)) && (i + 1 < argc - 1)) {
+            options->writeProfileFileName = argv[++i];
+        } else if ((0 == strcmp("-readprofile", arg)) && (i + 1 < argc - 1)) {
+            options->readProfileFileName = argv[++i];
         } else if (0 == strcmp("-it", arg)) {
             options->interpreterType = atol(argv[++i]);
             fprintf(stderr, "type %" PRIu64 "\n", options->interpreterType);
@@ -149,9 +347,133 @@ void setDefaultOptions(Options *options) {
     options->debugExecution = false;
     options->dumpProgram = false;
     options->parseOnly = false;
+    options->jitEnabled = true;
+    options->jitRequested = false;
+    options->baselineEnabled = true;
+    options->jitStatistics = false;
+    options->useMmap = true;
+    options->loadStatistics = false;
+    options->cacheDirectory = NULL;
+    options->jitCacheDirectory = NULL;
+    options->tieringSpec = NULL;
+    options->pairProfileFileName = NULL;
+    options->recordPairsFileName = NULL;
+    options->writeProfileFileName = NULL;
+    options->readProfileFileName = NULL;
+    options->useSuperinstructions = true;
+    options->compileThreads = 1;
     options->interpreterType = 0;
 }
 
+void startCompileQueue(VM *vm, Options *options) {
+    if (options->compileThreads > 0) {
+        vm->compileQueue = new CompileQueue(vm, options->compileThreads);
+    }
+}
+
+void stopCompileQueue(VM *vm, Options *options) {
+    if (nullptr != vm->compileQueue) {
+        vm->compileQueue->shutdown();
+        if (options->jitStatistics) {
+            vm->compileQueue->printStatistics(stderr);
+        }
+        delete vm->compileQueue;
+        vm->compileQueue = nullptr;
+    }
+}
+
+bool isSourceFile(const char *fileName) {
+    size_t length = strlen(fileName);
+    return (length > 3) && (0 == strcmp(".el", fileName + length - 3));
+}
+
+/* FNV-1a over the source and everything that changes what the compiler writes for it */
+static uint64_t hashSource(const std::string &source, CompilerOptions *compilerOptions) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < source.length(); i++) {
+        hash = (hash ^ (uint8_t)source[i]) * 1099511628211ULL;
+    }
+    hash = (hash ^ (uint64_t)compilerOptions->formatVersion) * 1099511628211ULL;
+    hash = (hash ^ (uint64_t)compilerOptions->nativeLayout) * 1099511628211ULL;
+    hash = (hash ^ (uint64_t)compilerOptions->functionDirectory) * 1099511628211ULL;
+    hash = (hash ^ (uint64_t)compilerOptions->optimizationLevel) * 1099511628211ULL;
+#if defined(EL_IS_BIG_ENDIAN)
+    hash = (hash ^ 1) * 1099511628211ULL;
+#endif
+    return hash;
+}
+
+/* Compiles a .el source in memory. When a cache directory is given and already
+ * holds the compiled program only its name is returned, otherwise the compiled
+ * image is returned and also stored in the cache for the next run.
+ */
+bool compileSourceProgram(Options *options, std::string *cachedProgramFile, int8_t **image, int64_t *imageSize) {
+    std::ifstream sourceFile(options->programFileName, std::ios::in | std::ios::binary);
+    if (!sourceFile.good()) {
+        fprintf(stderr, "Error opening %s\n", options->programFileName);
+        return false;
+    }
+    std::ostringstream sourceBuffer;
+    sourceBuffer << sourceFile.rdbuf();
+    std::string source = sourceBuffer.str();
+
+    /* the layout that loads fastest, bodies are used in place and only once they are called */
+    CompilerOptions compilerOptions;
+    setDefaultCompilerOptions(&compilerOptions);
+    compilerOptions.nativeLayout = true;
+    compilerOptions.functionDirectory = true;
+    compilerOptions.useStreamParser = true;
+    compilerOptions.optimizationLevel = 2;
+
+    if (NULL != options->cacheDirectory) {
+        char cacheName[32];
+        snprintf(cacheName, sizeof(cacheName), "/%016" PRIx64 ".le", hashSource(source, &compilerOptions));
+        *cachedProgramFile = std::string(options->cacheDirectory) + cacheName;
+        if (0 == access(cachedProgramFile->c_str(), R_OK)) {
+            return true;
+        }
+    }
+
+    std::istringstream sourceStream(source);
+    std::ostringstream compiled;
+    if (0 != compileProgram(sourceStream, options->programFileName, &compilerOptions, &compiled)) {
+        fprintf(stderr, "Error compiling %s\n", options->programFileName);
+        return false;
+    }
+    std::string compiledProgram = compiled.str();
+
+    if (NULL != options->cacheDirectory) {
+        /* write then rename so concurrent runs never see a partial file */
+        std::string temporaryFile = *cachedProgramFile + "." + std::to_string(getpid());
+        std::ofstream cacheFile(temporaryFile, std::ios::out | std::ios::binary);
+        cacheFile.write(compiledProgram.data(), compiledProgram.length());
+        cacheFile.close();
+        if (!cacheFile.good() || (0 != rename(temporaryFile.c_str(), cachedProgramFile->c_str()))) {
+            fprintf(stderr, "Warning: could not write %s to the cache\n", cachedProgramFile->c_str());
+            unlink(temporaryFile.c_str());
+        }
+    }
+
+    *image = (int8_t *)malloc(compiledProgram.length() > 0 ? compiledProgram.length() : 1);
+    if (NULL == *image) {
+        fprintf(stderr, "Error allocating the compiled program\n");
+        return false;
+    }
+    memcpy(*image, compiledProgram.data(), compiledProgram.length());
+    *imageSize = compiledProgram.length();
+    return true;
+}
+
+/* a different tiering policy makes different decisions, so it keys the JIT cache too */
+std::string jitCacheOptions(Options *options) {
+    const char *environmentTieringSpec = getenv("EL_TIERING");
+    std::string jitOptions = "tiering=";
+    jitOptions += (NULL != environmentTieringSpec) ? environmentTieringSpec : "";
+    jitOptions += ",";
+    jitOptions += (NULL != options->tieringSpec) ? options->tieringSpec : "";
+    return jitOptions;
+}
+
 Function *findMainFunction(Program *program) {
     Function **functions = program->functions;
     int functionCount = program->functionCount;
@@ -164,7 +486,7 @@ Function *findMainFunction(Program *program) {
 }
 
 void dumpProgram(Program *program) {
-    fprintf(stdout, "Dumping Program: %s\n", program->programName);
+    fprintf(stdout, "Dumping Program: %s (format version %" PRIu64 ")\n", program->programName, program->formatVersion);
     for (int i = 0; i < program->functionCount; i++) {
         Function * function = program->functions[i];
         char *functionName = function->functionName;
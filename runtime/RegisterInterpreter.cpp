@@ -0,0 +1,655 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <inttypes.h>
+#include <sys/time.h>
+#include <map>
+#include <vector>
+
+#include "EL.hpp"
+#include "Bytecodes.hpp"
+#include "Helpers.hpp"
+#include "RegisterInterpreter.hpp"
+
+#if INTERP_USE_COMPUTED_GOTO
+#define InstructionEntry(name) &&lbl_##name
+#define Instruction(name) lbl_##name
+#define Next goto *pc->handler
+#else
+#define Instruction(name) case name
+#define Next break
+#endif
+
+#define R(operand) (regs[pc->operand])
+
+/* Translates the stack bytecode of one function. Pushes of args, locals and
+ * constants only record which register holds the value, and the instruction
+ * that consumes the value reads that register directly. Values are copied
+ * into their operand stack slot registers only where control flow merges,
+ * where a call needs contiguous args, or before the local they came from is
+ * overwritten.
+ */
+class RegisterTranslator {
+public:
+    RegisterTranslator(VM *vm, Function *function) :
+        _vm(vm),
+        _function(function),
+        _localBase(function->argCount),
+        _stackBase(function->argCount + function->localCount),
+        _constantBase(function->argCount + function->localCount + function->maxStackDepth),
+        _lastResult(-1)
+    {}
+    RegisterCode *translate(const void * const *handlers);
+
+private:
+    int64_t getImmediate(int64_t index, int64_t immediate) {
+        return *((int64_t *)(_function->opcodes + index + immediate));
+    }
+    bool computeDepths();
+    int32_t constantRegister(int64_t value);
+    int32_t stackRegister(int64_t depth) { return (int32_t)(_stackBase + depth); }
+    int64_t emit(int32_t handler, int32_t destination, int32_t left, int32_t right);
+    void materialize(int64_t fromDepth);
+    void materializeRegister(int32_t reg);
+    int32_t pop();
+
+    VM *_vm;
+    Function *_function;
+    int64_t _localBase;
+    int64_t _stackBase;
+    int64_t _constantBase;
+    int64_t _lastResult; /* instruction that produced the canonical top of stack, or -1 */
+    std::vector<int64_t> _depths;
+    std::vector<bool> _jumpTargets;
+    std::vector<int32_t> _stack;
+    std::vector<RegisterInstruction> _code;
+    std::vector<int32_t> _handlers;
+    std::vector<int64_t> _bytecodeTargets;
+    std::vector<int64_t> _starts;
+    std::vector<int64_t> _constants;
+    std::map<int64_t, int32_t> _constantRegisters;
+};
+
+/* the verifier already guarantees one depth per instruction, this only finds it */
+bool RegisterTranslator::computeDepths() {
+    int64_t opcodeCount = _function->opcodeCount;
+    int8_t *opcodes = _function->opcodes;
+    _depths.assign(opcodeCount, -1);
+    _jumpTargets.assign(opcodeCount, false);
+    std::vector<int64_t> worklist;
+    if (opcodeCount > 0) {
+        _depths[0] = 0;
+        worklist.push_back(0);
+    }
+    while (!worklist.empty()) {
+        int64_t index = worklist.back();
+        worklist.pop_back();
+        int64_t depth = _depths[index];
+        Bytecodes bytecode = (Bytecodes)opcodes[index];
+        int64_t next = index + Bytecode::getBytecodeLength(bytecode);
+        int64_t target = -1;
+        bool fallsThrough = true;
+        switch (bytecode) {
+        case Bytecodes::PUSH_CONSTANT:
+        case Bytecodes::PUSH_ARG:
+        case Bytecodes::PUSH_LOCAL:
+        case Bytecodes::DUP:
+        case Bytecodes::CURRENT_TIME:
+            depth += 1;
+            break;
+        case Bytecodes::POP:
+        case Bytecodes::POP_LOCAL:
+        case Bytecodes::ADD:
+        case Bytecodes::SUB:
+        case Bytecodes::MUL:
+        case Bytecodes::DIV:
+        case Bytecodes::MOD:
+        case Bytecodes::PRINT_INT64:
+            depth -= 1;
+            break;
+        case Bytecodes::JMP:
+            target = getImmediate(index, IMMEDIATE0);
+            fallsThrough = false;
+            break;
+        case Bytecodes::JMPE:
+        case Bytecodes::JMPL:
+        case Bytecodes::JMPG:
+            target = getImmediate(index, IMMEDIATE0);
+            depth -= 2;
+            break;
+        case Bytecodes::CALL:
+            depth -= getImmediate(index, IMMEDIATE1) - 1;
+            break;
+        case Bytecodes::RET:
+        case Bytecodes::HALT:
+            fallsThrough = false;
+            break;
+        default:
+            break;
+        }
+        if (target >= 0) {
+            if (target >= opcodeCount) {
+                return false;
+            }
+            _jumpTargets[target] = true;
+            if (-1 == _depths[target]) {
+                _depths[target] = depth;
+                worklist.push_back(target);
+            }
+        }
+        if (fallsThrough && (next < opcodeCount) && (-1 == _depths[next])) {
+            _depths[next] = depth;
+            worklist.push_back(next);
+        }
+    }
+    return true;
+}
+
+int32_t RegisterTranslator::constantRegister(int64_t value) {
+    std::map<int64_t, int32_t>::iterator found = _constantRegisters.find(value);
+    if (found != _constantRegisters.end()) {
+        return found->second;
+    }
+    int32_t reg = (int32_t)(_constantBase + _constants.size());
+    _constants.push_back(value);
+    _constantRegisters[value] = reg;
+    return reg;
+}
+
+int64_t RegisterTranslator::emit(int32_t handler, int32_t destination, int32_t left, int32_t right) {
+    RegisterInstruction instruction;
+    instruction.handler = nullptr;
+    instruction.destination = destination;
+    instruction.left = left;
+    instruction.right = right;
+    instruction.argCount = 0;
+    instruction.operand.target = nullptr;
+    _code.push_back(instruction);
+    _handlers.push_back(handler);
+    _bytecodeTargets.push_back(-1);
+    _lastResult = -1;
+    return _code.size() - 1;
+}
+
+/* copies every value from fromDepth up into its own stack slot register */
+void RegisterTranslator::materialize(int64_t fromDepth) {
+    for (int64_t depth = fromDepth; depth < (int64_t)_stack.size(); depth++) {
+        if (_stack[depth] != stackRegister(depth)) {
+            emit(R_MOV, stackRegister(depth), _stack[depth], 0);
+            _stack[depth] = stackRegister(depth);
+        }
+    }
+}
+
+void RegisterTranslator::materializeRegister(int32_t reg) {
+    for (int64_t depth = 0; depth < (int64_t)_stack.size(); depth++) {
+        if (_stack[depth] == reg) {
+            emit(R_MOV, stackRegister(depth), reg, 0);
+            _stack[depth] = stackRegister(depth);
+        }
+    }
+}
+
+int32_t RegisterTranslator::pop() {
+    int32_t reg = _stack.back();
+    _stack.pop_back();
+    return reg;
+}
+
+RegisterCode *RegisterTranslator::translate(const void * const *handlers) {
+    if (!computeDepths()) {
+        fprintf(stderr, "Invalid jump target in function %s....exiting\n", _function->functionName);
+        exit(-1);
+    }
+    int64_t opcodeCount = _function->opcodeCount;
+    int8_t *opcodes = _function->opcodes;
+    _starts.assign(opcodeCount, -1);
+
+    bool flowEnded = false;
+    int64_t index = 0;
+    while (index < opcodeCount) {
+        Bytecodes bytecode = (Bytecodes)opcodes[index];
+        int64_t length = Bytecode::getBytecodeLength(bytecode);
+        if (-1 == _depths[index]) {
+            index += length;
+            continue;
+        }
+        if (_jumpTargets[index] || flowEnded) {
+            if (!flowEnded) {
+                materialize(0);
+            }
+            _stack.clear();
+            for (int64_t depth = 0; depth < _depths[index]; depth++) {
+                _stack.push_back(stackRegister(depth));
+            }
+            _lastResult = -1;
+        }
+        flowEnded = false;
+        _starts[index] = _code.size();
+
+        int64_t depth = _stack.size();
+        switch (bytecode) {
+        case Bytecodes::NOP:
+            break;
+        case Bytecodes::PUSH_CONSTANT:
+            _stack.push_back(constantRegister(getImmediate(index, IMMEDIATE0)));
+            break;
+        case Bytecodes::PUSH_ARG:
+            _stack.push_back((int32_t)getImmediate(index, IMMEDIATE0));
+            break;
+        case Bytecodes::PUSH_LOCAL:
+            _stack.push_back((int32_t)(_localBase + getImmediate(index, IMMEDIATE0)));
+            break;
+        case Bytecodes::POP:
+            pop();
+            break;
+        case Bytecodes::POP_LOCAL:
+        {
+            int32_t local = (int32_t)(_localBase + getImmediate(index, IMMEDIATE0));
+            int64_t producer = _lastResult;
+            int32_t value = pop();
+            bool referenced = false;
+            for (size_t i = 0; i < _stack.size(); i++) {
+                referenced = referenced || (_stack[i] == local);
+            }
+            if ((producer >= 0) && !referenced && (value == stackRegister(depth - 1)) && (_code[producer].destination == value)) {
+                /* the value was computed just for this store, compute it into the local instead */
+                _code[producer].destination = local;
+            } else if (value != local) {
+                materializeRegister(local);
+                emit(R_MOV, local, value, 0);
+            }
+            _lastResult = -1;
+            break;
+        }
+        case Bytecodes::DUP:
+            _stack.push_back(_stack.back());
+            break;
+        case Bytecodes::ADD:
+        case Bytecodes::SUB:
+        case Bytecodes::MUL:
+        case Bytecodes::DIV:
+        case Bytecodes::MOD:
+        {
+            int32_t right = pop();
+            int32_t left = pop();
+            int32_t handler = R_ADD + ((int32_t)bytecode - (int32_t)Bytecodes::ADD);
+            int64_t instruction = emit(handler, stackRegister(depth - 2), left, right);
+            _stack.push_back(stackRegister(depth - 2));
+            _lastResult = instruction;
+            break;
+        }
+        case Bytecodes::JMP:
+        {
+            materialize(0);
+            int64_t instruction = emit(R_JMP, 0, 0, 0);
+            _bytecodeTargets[instruction] = getImmediate(index, IMMEDIATE0);
+            flowEnded = true;
+            break;
+        }
+        case Bytecodes::JMPE:
+        case Bytecodes::JMPL:
+        case Bytecodes::JMPG:
+        {
+            int32_t right = pop();
+            int32_t left = pop();
+            materialize(0);
+            int32_t handler = R_JMPE + ((int32_t)bytecode - (int32_t)Bytecodes::JMPE);
+            int64_t instruction = emit(handler, 0, left, right);
+            _bytecodeTargets[instruction] = getImmediate(index, IMMEDIATE0);
+            break;
+        }
+        case Bytecodes::CALL:
+        {
+            int64_t argCount = getImmediate(index, IMMEDIATE1);
+            materialize(depth - argCount);
+            int64_t instruction = emit(R_CALL, stackRegister(depth - argCount), stackRegister(depth - argCount), 0);
+            _code[instruction].argCount = (int32_t)argCount;
+            _code[instruction].operand.function = _vm->functions[getImmediate(index, IMMEDIATE0)];
+            _stack.resize(depth - argCount);
+            _stack.push_back(stackRegister(depth - argCount));
+            _lastResult = instruction;
+            break;
+        }
+        case Bytecodes::RET:
+            emit(R_RET, 0, pop(), 0);
+            flowEnded = true;
+            break;
+        case Bytecodes::PRINT_STRING:
+        {
+            int64_t instruction = emit(R_PRINT_STRING, 0, 0, 0);
+            _code[instruction].operand.string = _vm->strings[getImmediate(index, IMMEDIATE0)];
+            break;
+        }
+        case Bytecodes::PRINT_INT64:
+            emit(R_PRINT_INT64, 0, pop(), 0);
+            break;
+        case Bytecodes::CURRENT_TIME:
+        {
+            int64_t instruction = emit(R_CURRENT_TIME, stackRegister(depth), 0, 0);
+            _stack.push_back(stackRegister(depth));
+            _lastResult = instruction;
+            break;
+        }
+        case Bytecodes::HALT:
+            emit(R_HALT, 0, 0, 0);
+            flowEnded = true;
+            break;
+        default:
+            fprintf(stderr, "Unknown opcode %d at index %" PRId64 " in function %s....exiting\n", (int32_t)bytecode, index, _function->functionName);
+            exit(-1);
+        }
+        index += length;
+    }
+
+    int64_t instructionCount = _code.size();
+    int64_t constantCount = _constants.size();
+    RegisterCode *code = (RegisterCode *)malloc(sizeof(RegisterCode) + instructionCount * sizeof(RegisterInstruction) + constantCount * sizeof(int64_t));
+    if (nullptr == code) {
+        fprintf(stderr, "Error allocating register code for function %s....exiting\n", _function->functionName);
+        exit(-1);
+    }
+    code->registerCount = _constantBase + constantCount;
+    code->constantBase = _constantBase;
+    code->constantCount = constantCount;
+    code->instructionCount = instructionCount;
+    code->instructions = (RegisterInstruction *)(code + 1);
+    code->constants = (int64_t *)(code->instructions + instructionCount);
+    for (int64_t i = 0; i < constantCount; i++) {
+        code->constants[i] = _constants[i];
+    }
+    for (int64_t i = 0; i < instructionCount; i++) {
+        RegisterInstruction *instruction = &code->instructions[i];
+        *instruction = _code[i];
+#if INTERP_USE_COMPUTED_GOTO
+        instruction->handler = handlers[_handlers[i]];
+#else
+        instruction->handler = (const void *)(intptr_t)_handlers[i];
+#endif
+        if (_bytecodeTargets[i] >= 0) {
+            int64_t start = _starts[_bytecodeTargets[i]];
+            if (start < 0) {
+                fprintf(stderr, "Invalid jump target %" PRId64 " in function %s....exiting\n", _bytecodeTargets[i], _function->functionName);
+                exit(-1);
+            }
+            instruction->operand.target = &code->instructions[start];
+        }
+    }
+    return code;
+}
+
+#define doMov() \
+do { \
+    R(destination) = R(left); \
+    pc += 1; \
+} while (0)
+
+#define doBinary(operator) \
+do { \
+    R(destination) = R(left) operator R(right); \
+    pc += 1; \
+} while (0)
+
+#define doJump() \
+do { \
+    pc = pc->operand.target; \
+} while (0)
+
+#define doCompareAndJump(operator) \
+do { \
+    if (R(left) operator R(right)) { \
+        pc = pc->operand.target; \
+    } else { \
+        pc += 1; \
+    } \
+} while (0)
+
+#define doCall() \
+do { \
+    Function *callee = pc->operand.function; \
+    RegisterCode *calleeCode = (RegisterCode *)callee->registerCode; \
+    if (nullptr == calleeCode) { \
+        calleeCode = translateFunction(vm, callee, tblArray); \
+    } \
+    RegisterFrame *newFrame = (RegisterFrame *)(regs + code->registerCount); \
+    int64_t *newRegs = (int64_t *)(newFrame + 1); \
+    if (newRegs + calleeCode->registerCount > vm->stackLimit) { \
+        fprintf(stderr, "VM stack overflow calling function %s....exiting\n", callee->functionName); \
+        exit(-1); \
+    } \
+    newFrame->previous = frame; \
+    newFrame->function = callee; \
+    newFrame->returnPC = pc + 1; \
+    newFrame->returnRegister = pc->destination; \
+    for (int32_t i = 0; i < pc->argCount; i++) { \
+        newRegs[i] = regs[pc->left + i]; \
+    } \
+    memcpy(newRegs + calleeCode->constantBase, calleeCode->constants, calleeCode->constantCount * sizeof(int64_t)); \
+    frame = newFrame; \
+    regs = newRegs; \
+    code = calleeCode; \
+    pc = calleeCode->instructions; \
+} while (0)
+
+#define doRet() \
+do { \
+    int64_t value = R(left); \
+    if (nullptr == frame->previous) { \
+        vm->stackTop = (int64_t *)frame; \
+        return value; \
+    } \
+    int64_t returnRegister = frame->returnRegister; \
+    pc = frame->returnPC; \
+    frame = frame->previous; \
+    regs = (int64_t *)(frame + 1); \
+    code = (RegisterCode *)frame->function->registerCode; \
+    regs[returnRegister] = value; \
+} while (0)
+
+#define doPrintString() \
+do { \
+    String *string = pc->operand.string; \
+    fprintf(stdout, "%.*s", (int32_t)string->length, string->data); \
+    pc += 1; \
+} while (0)
+
+#define doPrintInt64() \
+do { \
+    fprintf(stdout, "%" PRIu64, R(left)); \
+    pc += 1; \
+} while (0)
+
+#define doCurrentTime() \
+do { \
+    struct timeval tp; \
+    gettimeofday(&tp, NULL); \
+    R(destination) = ((int64_t)tp.tv_sec) * 1000 + tp.tv_usec / 1000; \
+    pc += 1; \
+} while (0)
+
+#define doHalt() \
+do { \
+    exit(0); \
+} while (0)
+
+RegisterInterpreter::RegisterInterpreter() {}
+
+RegisterCode *RegisterInterpreter::translateFunction(VM *vm, Function *function, const void * const *handlers) {
+    if (!ensureFunctionLoaded(vm, function)) {
+        fprintf(stderr, "Error loading function %s....exiting\n", function->functionName);
+        exit(-1);
+    }
+    RegisterTranslator translator(vm, function);
+    RegisterCode *code = translator.translate(handlers);
+    function->registerCode = (void *)code;
+    return code;
+}
+
+int64_t RegisterInterpreter::interpret(VM *vm, Function *function, int64_t *args) {
+#if INTERP_USE_COMPUTED_GOTO
+    static const void * const tblArray[] = {
+            InstructionEntry(R_MOV),
+            InstructionEntry(R_ADD),
+            InstructionEntry(R_SUB),
+            InstructionEntry(R_MUL),
+            InstructionEntry(R_DIV),
+            InstructionEntry(R_MOD),
+            InstructionEntry(R_JMP),
+            InstructionEntry(R_JMPE),
+            InstructionEntry(R_JMPL),
+            InstructionEntry(R_JMPG),
+            InstructionEntry(R_CALL),
+            InstructionEntry(R_RET),
+            InstructionEntry(R_PRINT_STRING),
+            InstructionEntry(R_PRINT_INT64),
+            InstructionEntry(R_CURRENT_TIME),
+            InstructionEntry(R_HALT)
+    };
+#else
+    static const void * const *tblArray = nullptr;
+#endif
+
+    RegisterCode *code = (RegisterCode *)function->registerCode;
+    if (nullptr == code) {
+        code = translateFunction(vm, function, tblArray);
+    }
+
+    RegisterFrame *frame = (RegisterFrame *)vm->stackTop;
+    int64_t *regs = (int64_t *)(frame + 1);
+    if (regs + code->registerCount > vm->stackLimit) {
+        fprintf(stderr, "VM stack overflow calling function %s....exiting\n", function->functionName);
+        exit(-1);
+    }
+    frame->previous = nullptr;
+    frame->function = function;
+    frame->returnPC = nullptr;
+    frame->returnRegister = 0;
+    for (int64_t i = 0; i < function->argCount; i++) {
+        regs[i] = args[i];
+    }
+    memcpy(regs + code->constantBase, code->constants, code->constantCount * sizeof(int64_t));
+
+    RegisterInstruction *pc = code->instructions;
+
+#if INTERP_USE_COMPUTED_GOTO
+    Next;
+#else
+    while (true) {
+        switch((intptr_t)pc->handler) {
+#endif
+        Instruction(R_MOV):
+        {
+            doMov();
+            Next;
+        }
+        Instruction(R_ADD):
+        {
+            doBinary(+);
+            Next;
+        }
+        Instruction(R_SUB):
+        {
+            doBinary(-);
+            Next;
+        }
+        Instruction(R_MUL):
+        {
+            doBinary(*);
+            Next;
+        }
+        Instruction(R_DIV):
+        {
+            doBinary(/);
+            Next;
+        }
+        Instruction(R_MOD):
+        {
+            doBinary(%);
+            Next;
+        }
+        Instruction(R_JMP):
+        {
+            doJump();
+            Next;
+        }
+        Instruction(R_JMPE):
+        {
+            doCompareAndJump(==);
+            Next;
+        }
+        Instruction(R_JMPL):
+        {
+            doCompareAndJump(<);
+            Next;
+        }
+        Instruction(R_JMPG):
+        {
+            doCompareAndJump(>);
+            Next;
+        }
+        Instruction(R_CALL):
+        {
+            doCall();
+            Next;
+        }
+        Instruction(R_RET):
+        {
+            doRet();
+            Next;
+        }
+        Instruction(R_PRINT_STRING):
+        {
+            doPrintString();
+            Next;
+        }
+        Instruction(R_PRINT_INT64):
+        {
+            doPrintInt64();
+            Next;
+        }
+        Instruction(R_CURRENT_TIME):
+        {
+            doCurrentTime();
+            Next;
+        }
+        Instruction(R_HALT):
+        {
+            doHalt();
+        }
+#if !INTERP_USE_COMPUTED_GOTO
+        default:
+            fprintf(stderr, "Unknown register instruction %" PRIdPTR "....exiting\n", (intptr_t)pc->handler);
+            exit(-1);
+        }
+    }
+#endif
+    return 0;
+}
+
+int64_t r_interpret(VM *vm, Function *function, int64_t *args) {
+    RegisterInterpreter interp;
+    return interp.interpret(vm, function, args);
+}
@@ -0,0 +1,99 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "EL.hpp"
+#include "Bytecodes.hpp"
+
+#ifndef REGISTERINTERPRETER_INCL
+#define REGISTERINTERPRETER_INCL
+
+enum {
+    R_MOV,
+    R_ADD,
+    R_SUB,
+    R_MUL,
+    R_DIV,
+    R_MOD,
+    R_JMP,
+    R_JMPE,
+    R_JMPL,
+    R_JMPG,
+    R_CALL,
+    R_RET,
+    R_PRINT_STRING,
+    R_PRINT_INT64,
+    R_CURRENT_TIME,
+    R_HALT
+};
+
+/* Three address form of a bytecode or of a run of them. Operands are indices
+ * into the register file of the activation, which holds the args, the
+ * locals, one register per operand stack slot and the function's constants
+ * in that order.
+ */
+typedef struct RegisterInstruction {
+    const void *handler;
+    int32_t destination;
+    int32_t left;
+    int32_t right;
+    int32_t argCount;
+    union {
+        struct RegisterInstruction *target;
+        Function *function;
+        String *string;
+    } operand;
+} RegisterInstruction;
+
+/* Function::registerCode */
+typedef struct RegisterCode {
+    int64_t registerCount;
+    int64_t constantBase;
+    int64_t constantCount;
+    int64_t *constants;
+    int64_t instructionCount;
+    RegisterInstruction *instructions;
+} RegisterCode;
+
+/* Header of a register interpreter activation on the VM stack, its register file follows it */
+typedef struct RegisterFrame {
+    struct RegisterFrame *previous;
+    Function *function;
+    RegisterInstruction *returnPC;
+    int64_t returnRegister;
+} RegisterFrame;
+
+class RegisterInterpreter {
+public:
+    RegisterInterpreter();
+    int64_t interpret(VM *vm, Function *function, int64_t *args);
+
+private:
+    RegisterCode *translateFunction(VM *vm, Function *function, const void * const *handlers);
+};
+
+int64_t r_interpret(VM *vm, Function *function, int64_t *args);
+
+#endif /* REGISTERINTERPRETER_INCL */
@@ -0,0 +1,411 @@
+/*******************************************************************************
+ * Copyright (c) 2016, 2018 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <inttypes.h>
+#include <sys/time.h>
+#include "EL.hpp"
+
+#include "Helpers.hpp"
+#include "CInterpreter.hpp"
+#include "TailCallInterpreter.hpp"
+
+/* Every dispatch has to compile to a jump or the native stack grows with each
+ * executed bytecode. musttail guarantees that. Without it the handlers rely on
+ * sibling call optimization, which compilers only do in optimized builds.
+ */
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define MUSTTAIL [[clang::musttail]]
+#endif
+#endif
+#if !defined(MUSTTAIL) && defined(__has_attribute)
+#if __has_attribute(musttail)
+#define MUSTTAIL __attribute__((musttail))
+#endif
+#endif
+#if !defined(MUSTTAIL)
+#if !defined(__OPTIMIZE__)
+#error "TailCallInterpreter.cpp needs a compiler with musttail or an optimized build"
+#endif
+#define MUSTTAIL
+#endif
+
+/* locals directly follow the frame header so they are not passed separately */
+#define TAIL_PARAMETERS ThreadedInstruction *pc, int64_t *sp, int64_t tos, InterpreterFrame *iframe, int64_t *args, VM *vm
+#define TAIL_ARGUMENTS pc, sp, tos, iframe, args, vm
+#define LOCALS ((int64_t *)(iframe + 1))
+
+typedef int64_t (TailHandler)(TAIL_PARAMETERS);
+
+#define Handler(name) static int64_t tail_##name(TAIL_PARAMETERS)
+#define HandlerEntry(name) (const void *)&tail_##name
+#define Next() MUSTTAIL return ((TailHandler *)pc->handler)(TAIL_ARGUMENTS)
+
+/* same stack layout as CInterpreter built with INTERP_CACHE_TOS 1 */
+#define PUSH(value) \
+do { \
+    int64_t pushed = (value); \
+    *sp++ = tos; \
+    tos = pushed; \
+} while (0)
+#define POP() ({ int64_t popped = tos; tos = *--sp; popped; })
+#define PEEK() (tos)
+/* flushing tos on a full stack writes one slot past maxStackDepth */
+#define OPERAND_STACK_SLOTS(function) ((function)->maxStackDepth + 1)
+
+#define doBinary(op) \
+do { \
+    int64_t right = POP(); \
+    PEEK() = PEEK() op right; \
+    pc += 1; \
+} while (0)
+
+#define doCompareAndJump(op) \
+do { \
+    int64_t right = POP(); \
+    int64_t left = POP(); \
+    if (left op right) { \
+        pc = pc->operand.target; \
+    } else { \
+        pc += 1; \
+    } \
+} while (0)
+
+static ThreadedInstruction *translate(VM *vm, Function *function);
+static int64_t currentTimeMillis();
+
+Handler(NOP) {
+    pc += 1;
+    Next();
+}
+
+Handler(PUSH_CONSTANT) {
+    PUSH(pc->operand.value);
+    pc += 1;
+    Next();
+}
+
+Handler(PUSH_ARG) {
+    PUSH(args[pc->operand.value]);
+    pc += 1;
+    Next();
+}
+
+Handler(PUSH_LOCAL) {
+    PUSH(LOCALS[pc->operand.value]);
+    pc += 1;
+    Next();
+}
+
+Handler(POP) {
+    tos = *--sp;
+    pc += 1;
+    Next();
+}
+
+Handler(POP_LOCAL) {
+    LOCALS[pc->operand.value] = POP();
+    pc += 1;
+    Next();
+}
+
+Handler(DUP) {
+    PUSH(tos);
+    pc += 1;
+    Next();
+}
+
+Handler(ADD) {
+    doBinary(+);
+    Next();
+}
+
+Handler(SUB) {
+    doBinary(-);
+    Next();
+}
+
+Handler(MUL) {
+    doBinary(*);
+    Next();
+}
+
+Handler(DIV) {
+    doBinary(/);
+    Next();
+}
+
+Handler(MOD) {
+    doBinary(%);
+    Next();
+}
+
+/* the JIT is off for this engine so back edges translate to these as well */
+Handler(JMP) {
+    pc = pc->operand.target;
+    Next();
+}
+
+Handler(JMPE) {
+    doCompareAndJump(==);
+    Next();
+}
+
+Handler(JMPL) {
+    doCompareAndJump(<);
+    Next();
+}
+
+Handler(JMPG) {
+    doCompareAndJump(>);
+    Next();
+}
+
+Handler(CALL) {
+    Function *toCall = pc->operand.function;
+    *sp = tos;
+    int64_t *stackEnd = sp + 1;
+    ThreadedInstruction *callee = (ThreadedInstruction *)toCall->threadedCode;
+    if (nullptr == callee) {
+        callee = translate(vm, toCall);
+    }
+    InterpreterFrame *newFrame = (InterpreterFrame *)stackEnd;
+    int64_t *newStack = (int64_t *)(newFrame + 1) + toCall->localCount;
+    if (newStack + OPERAND_STACK_SLOTS(toCall) > vm->stackLimit) {
+        fprintf(stderr, "VM stack overflow calling function %s....exiting\n", toCall->functionName);
+        exit(-1);
+    }
+    newFrame->previous = iframe;
+    newFrame->function = toCall;
+    newFrame->returnPC = pc + 1;
+    newFrame->args = stackEnd - pc->argCount;
+    iframe = newFrame;
+    args = newFrame->args;
+    sp = newStack;
+    pc = callee;
+    Next();
+}
+
+Handler(RET) {
+    int64_t retVal = POP();
+    if (nullptr == iframe->previous) {
+        vm->stackTop = (int64_t *)iframe;
+        return retVal;
+    }
+    sp = iframe->args; /* pops the callee's args off of the caller's stack */
+    tos = retVal;
+    pc = iframe->returnPC;
+    iframe = iframe->previous;
+    args = iframe->args;
+    Next();
+}
+
+Handler(PRINT_STRING) {
+    String *string = pc->operand.string;
+    fprintf(stdout, "%.*s", (int32_t)string->length, string->data);
+    pc += 1;
+    Next();
+}
+
+Handler(PRINT_INT64) {
+    fprintf(stdout, "%" PRIu64, POP());
+    pc += 1;
+    Next();
+}
+
+Handler(CURRENT_TIME) {
+    PUSH(currentTimeMillis());
+    pc += 1;
+    Next();
+}
+
+Handler(HALT) {
+    exit(0);
+}
+
+Handler(LOCAL_CONSTANT_ADD) {
+    PUSH(LOCALS[pc[0].operand.value] + pc[1].operand.value);
+    pc += 3;
+    Next();
+}
+
+Handler(LOCAL_CONSTANT_SUB) {
+    PUSH(LOCALS[pc[0].operand.value] - pc[1].operand.value);
+    pc += 3;
+    Next();
+}
+
+Handler(LOCAL_LOCAL_JMPL) {
+    if (LOCALS[pc[0].operand.value] < LOCALS[pc[1].operand.value]) {
+        pc = pc[2].operand.target;
+    } else {
+        pc += 3;
+    }
+    Next();
+}
+
+Handler(LOCAL_ARG_JMPG) {
+    if (LOCALS[pc[0].operand.value] > args[pc[1].operand.value]) {
+        pc = pc[2].operand.target;
+    } else {
+        pc += 3;
+    }
+    Next();
+}
+
+Handler(LOCAL_LOCAL) {
+    PUSH(LOCALS[pc[0].operand.value]);
+    PUSH(LOCALS[pc[1].operand.value]);
+    pc += 2;
+    Next();
+}
+
+Handler(CONSTANT_ADD) {
+    PEEK() = PEEK() + pc[0].operand.value;
+    pc += 2;
+    Next();
+}
+
+Handler(CONSTANT_POP_LOCAL) {
+    LOCALS[pc[1].operand.value] = pc[0].operand.value;
+    pc += 2;
+    Next();
+}
+
+Handler(CONSTANT_JMPE) {
+    int64_t left = POP();
+    if (left == pc[0].operand.value) {
+        pc = pc[1].operand.target;
+    } else {
+        pc += 2;
+    }
+    Next();
+}
+
+Handler(CONSTANT_JMPL) {
+    int64_t left = POP();
+    if (left < pc[0].operand.value) {
+        pc = pc[1].operand.target;
+    } else {
+        pc += 2;
+    }
+    Next();
+}
+
+Handler(DUP_POP_LOCAL) {
+    LOCALS[pc[1].operand.value] = PEEK();
+    pc += 2;
+    Next();
+}
+
+/* indexed by the CInterpreter enum */
+static const void * const tailHandlers[] = {
+    HandlerEntry(NOP),
+    HandlerEntry(PUSH_CONSTANT),
+    HandlerEntry(PUSH_ARG),
+    HandlerEntry(PUSH_LOCAL),
+    HandlerEntry(POP),
+    HandlerEntry(POP_LOCAL),
+    HandlerEntry(DUP),
+    HandlerEntry(ADD),
+    HandlerEntry(SUB),
+    HandlerEntry(MUL),
+    HandlerEntry(DIV),
+    HandlerEntry(MOD),
+    HandlerEntry(JMP),
+    HandlerEntry(JMPE),
+    HandlerEntry(JMPL),
+    HandlerEntry(JMPG),
+    HandlerEntry(CALL),
+    HandlerEntry(RET),
+    HandlerEntry(PRINT_STRING),
+    HandlerEntry(PRINT_INT64),
+    HandlerEntry(CURRENT_TIME),
+    HandlerEntry(HALT),
+    HandlerEntry(JMP),
+    HandlerEntry(JMPE),
+    HandlerEntry(JMPL),
+    HandlerEntry(JMPG),
+    HandlerEntry(LOCAL_CONSTANT_ADD),
+    HandlerEntry(LOCAL_CONSTANT_SUB),
+    HandlerEntry(LOCAL_LOCAL_JMPL),
+    HandlerEntry(LOCAL_ARG_JMPG),
+    HandlerEntry(LOCAL_LOCAL),
+    HandlerEntry(CONSTANT_ADD),
+    HandlerEntry(CONSTANT_POP_LOCAL),
+    HandlerEntry(CONSTANT_JMPE),
+    HandlerEntry(CONSTANT_JMPL),
+    HandlerEntry(DUP_POP_LOCAL)
+};
+
+/* out of line so no handler keeps a local whose address escapes, which would stop sibling calls */
+static __attribute__((noinline)) ThreadedInstruction *translate(VM *vm, Function *function) {
+    CInterpreter translator;
+    return translator.translateFunction(vm, function, tailHandlers);
+}
+
+static __attribute__((noinline)) int64_t currentTimeMillis() {
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return ((int64_t)tp.tv_sec) * 1000 + tp.tv_usec / 1000;
+}
+
+int64_t TailCallInterpreter::interpret(VM *vm, Function *function, int64_t *args) {
+    ThreadedInstruction *code = (ThreadedInstruction *)function->threadedCode;
+    if (nullptr == code) {
+        code = translate(vm, function);
+    }
+
+    InterpreterFrame *iframe = (InterpreterFrame *)vm->stackTop;
+    int64_t *entryLocals = (int64_t *)(iframe + 1);
+    int64_t *entryStack = entryLocals + function->localCount;
+    if (entryStack + OPERAND_STACK_SLOTS(function) > vm->stackLimit) {
+        fprintf(stderr, "VM stack overflow calling function %s....exiting\n", function->functionName);
+        exit(-1);
+    }
+    iframe->previous = nullptr;
+    iframe->function = function;
+    iframe->returnPC = nullptr;
+    iframe->args = args;
+
+    Frame f;
+    Frame *frame = &f;
+    frame->function = function;
+    frame->stack = entryStack;
+    frame->locals = entryLocals;
+    frame->args = args;
+    frame->previous = vm->frame;
+    vm->frame = frame;
+
+    int64_t result = ((TailHandler *)code->handler)(code, entryStack, 0, iframe, args, vm);
+    vm->frame = frame->previous;
+    return result;
+}
+
+int64_t t_interpret(VM *vm, Function *function, int64_t *args) {
+    TailCallInterpreter interp;
+    return interp.interpret(vm, function, args);
+}
@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "EL.hpp"
+#include "CInterpreter.hpp"
+
+#ifndef TAILCALLINTERPRETER_INCL
+#define TAILCALLINTERPRETER_INCL
+
+/* Runs the same threaded code as CInterpreter but every handler is its own
+ * function that ends by tail calling the handler of the next instruction, so
+ * pc, sp, tos, the frame and the VM stay in argument registers throughout.
+ * Only built with EL_TAILCALL_INTERPRETER, see TailCallInterpreter.cpp for
+ * what the compiler has to support.
+ */
+class TailCallInterpreter {
+public:
+    TailCallInterpreter() {}
+    int64_t interpret(VM *vm, Function *function, int64_t *args);
+};
+
+int64_t t_interpret(VM *vm, Function *function, int64_t *args);
+
+#endif /* TAILCALLINTERPRETER_INCL */
@@ -0,0 +1,174 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <inttypes.h>
+#include "EL.hpp"
+
+#include "TieringPolicy.hpp"
+
+TieringPolicy::TieringPolicy() :
+    _baselineThreshold(INVOCATIONS_BEFORE_BASELINE),
+    _compileThreshold(INVOCATIONS_BEFORE_COMPILE),
+    _osrThreshold(BACKEDGES_BEFORE_OSR),
+    _recompileInvocations(INVOCATIONS_BEFORE_RECOMPILE),
+    _recompileBackEdges(BACKEDGES_BEFORE_RECOMPILE),
+    _decayInterval(0),
+    _sizeWeight(0),
+    _inlineDepth(INLINE_DEPTH),
+    _callsUntilDecay(0),
+    _neverCompile(),
+    _alwaysCompile()
+{}
+
+/* spec is a comma separated list of key=value, later keys win */
+bool TieringPolicy::configure(const char *spec) {
+    std::string entries(spec);
+    size_t start = 0;
+    while (start <= entries.size()) {
+        size_t end = entries.find(',', start);
+        if (std::string::npos == end) {
+            end = entries.size();
+        }
+        std::string entry = entries.substr(start, end - start);
+        start = end + 1;
+        if (entry.empty()) {
+            continue;
+        }
+        size_t equals = entry.find('=');
+        if (std::string::npos == equals) {
+            fprintf(stderr, "Tiering option \"%s\" is not key=value\n", entry.c_str());
+            return false;
+        }
+        if (!setOption(entry.substr(0, equals), entry.substr(equals + 1))) {
+            return false;
+        }
+    }
+    _callsUntilDecay = _decayInterval;
+    return true;
+}
+
+bool TieringPolicy::setOption(const std::string &key, const std::string &value) {
+    if ("baseline" == key) {
+        return parseCount(key, value, 0, &_baselineThreshold);
+    } else if ("compile" == key) {
+        return parseCount(key, value, 1, &_compileThreshold);
+    } else if ("osr" == key) {
+        return parseCount(key, value, 1, &_osrThreshold);
+    } else if ("recompile" == key) {
+        return parseCount(key, value, 1, &_recompileInvocations);
+    } else if ("recompilebackedges" == key) {
+        return parseCount(key, value, 1, &_recompileBackEdges);
+    } else if ("decay" == key) {
+        return parseCount(key, value, 0, &_decayInterval);
+    } else if ("sizeweight" == key) {
+        return parseCount(key, value, 0, &_sizeWeight);
+    } else if ("inline" == key) {
+        return parseCount(key, value, 0, &_inlineDepth);
+    } else if ("never" == key) {
+        parseNames(value, _neverCompile);
+        return true;
+    } else if ("always" == key) {
+        parseNames(value, _alwaysCompile);
+        return true;
+    }
+    fprintf(stderr, "Unknown tiering option \"%s\"\n", key.c_str());
+    return false;
+}
+
+bool TieringPolicy::parseCount(const std::string &key, const std::string &value, int64_t minimum, int64_t *count) {
+    char *end = nullptr;
+    errno = 0;
+    long long parsed = strtoll(value.c_str(), &end, 10);
+    if (value.empty() || ('\0' != *end) || (0 != errno) || (parsed < minimum)) {
+        fprintf(stderr, "Tiering option %s needs a count of at least %" PRId64 ", not \"%s\"\n", key.c_str(), minimum, value.c_str());
+        return false;
+    }
+    *count = parsed;
+    return true;
+}
+
+/* function names are separated by ':' since ',' separates options */
+void TieringPolicy::parseNames(const std::string &value, std::set<std::string> &names) {
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(':', start);
+        if (std::string::npos == end) {
+            end = value.size();
+        }
+        if (end > start) {
+            names.insert(value.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+}
+
+void TieringPolicy::apply(Function **functions, int64_t functionCount) {
+    for (int64_t i = 0; i < functionCount; i++) {
+        apply(functions[i]);
+    }
+}
+
+void TieringPolicy::apply(Function *function) {
+    std::string name(function->functionName);
+    if (_neverCompile.end() != _neverCompile.find(name)) {
+        /* fails the invokedCount < compileThreshold guard so calls are never counted */
+        function->baselineThreshold = 0;
+        function->compileThreshold = 0;
+        function->osrThreshold = INT64_MAX;
+        return;
+    }
+    function->osrThreshold = _osrThreshold;
+    if (_alwaysCompile.end() != _alwaysCompile.find(name)) {
+        /* compiled by its first call */
+        function->baselineThreshold = 0;
+        function->compileThreshold = 1;
+        return;
+    }
+    /* bigger functions take longer to compile so they have to earn it */
+    int64_t weight = (_sizeWeight * function->opcodeCount) / 100;
+    function->compileThreshold = (weight < INT64_MAX - _compileThreshold) ? _compileThreshold + weight : INT64_MAX;
+    function->baselineThreshold = (_baselineThreshold < function->compileThreshold) ? _baselineThreshold : 0;
+}
+
+/* Halves the counters of everything not yet compiled, so a function has to be
+ * called often relative to the rest of the program and not just often.
+ */
+void TieringPolicy::decayCounters(VM *vm) {
+    _callsUntilDecay = _decayInterval;
+    for (int64_t i = 0; i < vm->functionCount; i++) {
+        Function *function = vm->functions[i];
+        if (function->invokedCount < function->compileThreshold) {
+            function->invokedCount /= 2;
+        }
+    }
+}
+
+void TieringPolicy::printConfiguration(FILE *out) {
+    fprintf(out, "Tiering: baseline=%" PRId64 " compile=%" PRId64 " osr=%" PRId64 " recompile=%" PRId64 " recompilebackedges=%" PRId64 " decay=%" PRId64 " sizeweight=%" PRId64 " inline=%" PRId64 "\n",
+            _baselineThreshold, _compileThreshold, _osrThreshold, _recompileInvocations, _recompileBackEdges, _decayInterval, _sizeWeight, _inlineDepth);
+    fprintf(out, "Tiering: %zu functions never compiled, %zu always compiled\n", _neverCompile.size(), _alwaysCompile.size());
+}
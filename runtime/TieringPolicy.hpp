@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * Copyright (c) 2019, 2019 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <set>
+#include <string>
+
+#include "EL.hpp"
+#include "Helpers.hpp"
+#include "BaselineCompiler.hpp"
+
+#ifndef TIERINGPOLICY_INCL
+#define TIERINGPOLICY_INCL
+
+/* Decides when functions move between tiers. The defaults are the
+ * INVOCATIONS_BEFORE_* and BACKEDGES_BEFORE_* defines and can be overridden
+ * from EL_TIERING and -tiering with a spec such as
+ * "compile=100,decay=10000,never=main:init". apply() turns the spec into the
+ * per-function thresholds in Function that the engines test, so the engines
+ * only consult the policy itself once a function has to be counted.
+ */
+class TieringPolicy {
+public:
+    TieringPolicy();
+
+    bool configure(const char *spec);
+    void apply(Function **functions, int64_t functionCount);
+    void apply(Function *function);
+    void decayCounters(VM *vm);
+    void printConfiguration(FILE *out);
+
+    int64_t recompileInvocations() { return _recompileInvocations; }
+    int64_t recompileBackEdges() { return _recompileBackEdges; }
+    int64_t inlineDepth() { return _inlineDepth; }
+
+    /* Counts one call of a function whose invokedCount is still below its
+     * compileThreshold and starts the compiles it has earned.
+     */
+    void countInvocation(VM *vm, Function *function) {
+        function->invokedCount += 1;
+        if (vm->baselineEnabled && (function->baselineThreshold == function->invokedCount)) {
+            compileBaselineFunction(vm, function);
+        }
+        if (vm->jitEnabled && (function->compileThreshold == function->invokedCount)) {
+            compileFunction(vm, function);
+        }
+        if ((0 != _decayInterval) && (--_callsUntilDecay <= 0)) {
+            decayCounters(vm);
+        }
+    }
+
+private:
+    bool setOption(const std::string &key, const std::string &value);
+    static bool parseCount(const std::string &key, const std::string &value, int64_t minimum, int64_t *count);
+    static void parseNames(const std::string &value, std::set<std::string> &names);
+
+    int64_t _baselineThreshold;    /* 0 leaves out the baseline tier */
+    int64_t _compileThreshold;
+    int64_t _osrThreshold;
+    int64_t _recompileInvocations;
+    int64_t _recompileBackEdges;
+    int64_t _decayInterval;        /* counted calls between halving all counters, 0 for never */
+    int64_t _sizeWeight;           /* extra invocations before compiling per 100 bytes of bytecode */
+    int64_t _inlineDepth;          /* calls a hot body inlines into each other, 0 for none */
+    int64_t _callsUntilDecay;
+    std::set<std::string> _neverCompile;
+    std::set<std::string> _alwaysCompile;
+};
+
+#endif /* TIERINGPOLICY_INCL */
@@ -0,0 +1,33 @@
+# Compiles SOURCE with elc (ELC) using both front ends for each option set and
+# fails unless the images are byte for byte identical. Run with
+#   cmake -DELC=<elc> -DSOURCE=<file.el> -DWORK_DIR=<dir> -P CompareFrontEnds.cmake
+
+get_filename_component(name ${SOURCE} NAME_WE)
+# option sets are comma separated since a list cannot hold lists
+set(optionSets "default" "-format,0" "-native,-directory" "-O2")
+set(index 0)
+foreach(optionSet ${optionSets})
+	string(REPLACE "," ";" options "${optionSet}")
+	if("default" STREQUAL "${optionSet}")
+		set(options)
+	endif()
+	foreach(frontend antlr stream)
+		set(outputDir ${WORK_DIR}/${index}/${frontend})
+		file(MAKE_DIRECTORY ${outputDir})
+		execute_process(COMMAND ${ELC} ${options} -frontend ${frontend} ${SOURCE}
+			WORKING_DIRECTORY ${outputDir}
+			RESULT_VARIABLE result
+			OUTPUT_QUIET
+		)
+		if(NOT "0" STREQUAL "${result}")
+			message(FATAL_ERROR "elc ${options} -frontend ${frontend} ${SOURCE} failed: ${result}")
+		endif()
+	endforeach()
+	execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/${index}/antlr/${name}.le ${WORK_DIR}/${index}/stream/${name}.le
+		RESULT_VARIABLE different
+	)
+	if(different)
+		message(FATAL_ERROR "The ANTLR and stream front ends compile ${SOURCE} differently with options \"${options}\"")
+	endif()
+	math(EXPR index "${index} + 1")
+endforeach()
@@ -0,0 +1,25 @@
+# Runs SOURCE with el (EL) and the space separated EL_OPTIONS and fails unless
+# what it prints on stdout is EXPECTED. Timings change from run to run so they
+# are masked the same way the expected files are. Run with
+#   cmake -DEL=<el> "-DEL_OPTIONS=<options>" -DSOURCE=<file.el> -DEXPECTED=<file.out> -DWORK_DIR=<dir> -P RunExample.cmake
+
+separate_arguments(options UNIX_COMMAND "${EL_OPTIONS}")
+file(MAKE_DIRECTORY ${WORK_DIR})
+execute_process(COMMAND ${EL} ${options} ${SOURCE}
+	WORKING_DIRECTORY ${WORK_DIR}
+	RESULT_VARIABLE result
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE errors
+)
+if(NOT "0" STREQUAL "${result}")
+	message(FATAL_ERROR "el ${EL_OPTIONS} ${SOURCE} failed: ${result}\n${errors}")
+endif()
+string(REGEX REPLACE "executed in [0-9]+ms" "executed in Nms" output "${output}")
+string(REGEX REPLACE "millis is [0-9]+" "millis is T" output "${output}")
+file(WRITE ${WORK_DIR}/output.out "${output}")
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/output.out ${EXPECTED}
+	RESULT_VARIABLE different
+)
+if(different)
+	message(FATAL_ERROR "el ${EL_OPTIONS} ${SOURCE} printed ${WORK_DIR}/output.out, not ${EXPECTED}")
+endif()
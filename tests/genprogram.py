@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+#
+# Writes a generated EL program for the load and compile time tests.
+#
+#   genprogram.py <output.el> <functions> <instructions per function>
+#
+# main calls a chain through the first ten functions, so running the program
+# only touches a few of them however many there are. Every function adds
+# constants to a local and has a forward conditional jump every few blocks,
+# so labels get resolved too.
+
+import sys
+
+CALL_CHAIN_LENGTH = 10
+
+
+def function_body(index, functions, instructions):
+    body = ["\tPUSH_ARG 0", "\tPOP_LOCAL 0"]
+    tail = ["\tPUSH_LOCAL 0"]
+    if (index + 1 < CALL_CHAIN_LENGTH) and (index + 1 < functions):
+        tail.append("\tCALL f%d 1" % (index + 1))
+    tail.append("\tRET")
+    count = len(body) + len(tail)
+    block = 0
+    while count + 4 <= instructions:
+        if (block % 8 == 7) and (count + 7 <= instructions):
+            label = "SKIP%d" % block
+            body += ["\tPUSH_LOCAL 0", "\tPUSH_CONSTANT 0", "\tJMPL " + label,
+                     "\tPUSH_LOCAL 0", "\tPUSH_CONSTANT 1", "\tSUB", "\tPOP_LOCAL 0",
+                     label + ":"]
+            count += 7
+        else:
+            body += ["\tPUSH_LOCAL 0", "\tPUSH_CONSTANT %d" % block, "\tADD", "\tPOP_LOCAL 0"]
+            count += 4
+        block += 1
+    return body + tail
+
+
+def main(argv):
+    if len(argv) != 4:
+        sys.stderr.write("Usage: genprogram.py <output.el> <functions> <instructions per function>\n")
+        return 1
+    output = argv[1]
+    functions = int(argv[2])
+    instructions = int(argv[3])
+    with open(output, "w") as out:
+        out.write("Generated\n\nDEF main 0\n\tPUSH_CONSTANT 1\n\tCALL f0 1\n\tPRINT_INT64\n\tPRINT_STRING \"\\n\"\n\tPUSH_CONSTANT 0\n\tRET\nend\n")
+        for index in range(functions):
+            out.write("\nDEF f%d 1\n" % index)
+            out.write("\n".join(function_body(index, functions, instructions)))
+            out.write("\nend\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))